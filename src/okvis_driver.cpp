@@ -44,10 +44,17 @@
 
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <stdlib.h>
 #include <memory>
 #include <functional>
 #include <atomic>
+#include <mutex>
+#include <chrono>
+#include <map>
+#include <thread>
+#include <algorithm>
+#include <limits>
 
 #include <Eigen/Core>
 
@@ -58,9 +65,31 @@
 #pragma GCC diagnostic pop
 #include <okvis/VioParametersReader.hpp>
 #include <okvis/ThreadedKFVio.hpp>
+#include <okvis/cameras/PinholeCamera.hpp>
+#include <okvis/cameras/NoDistortion.hpp>
+#include <okvis/cameras/RadialTangentialDistortion.hpp>
+#include <okvis/cameras/RadialTangentialDistortion8.hpp>
+#include <okvis/cameras/EquidistantDistortion.hpp>
 
 #include <boost/filesystem.hpp>
+
 #include "util/glfwManager.h"
+#include "util/image_prefetcher.hpp"
+#include "util/dataset.hpp"
+#include "util/sensor_scheduler.hpp"
+#include "util/replay_clock.hpp"
+#include "util/batch_runner.hpp"
+#include "util/frame_cache.hpp"
+#include "util/image_decoder.hpp"
+#include "util/frame_transform.hpp"
+#include "util/snapshot_queue.hpp"
+#include "util/path_lod.hpp"
+#include "util/trajectory_writer.hpp"
+#include "util/trajectory_evaluator.hpp"
+#include "util/state_history.hpp"
+#include "util/command_queue.hpp"
+#include "util/png_sequence_writer.hpp"
+#include "util/time_profiler.hpp"
 
 class PoseViewer
 {
@@ -70,139 +99,322 @@ class PoseViewer
 
   MyGUI::Axis _axis = MyGUI::Axis("Axis2",1);
   MyGUI::Path _path3d= MyGUI::Path("Path1",Eigen::Vector3d(1, 0, 0));
-  PoseViewer()
+  MyGUI::Path _groundTruth3d = MyGUI::Path("GroundTruth",Eigen::Vector3d(0, 1, 0));
+  // the history keeps at most historyMemory bytes on the heap, see StateHistory.
+  // The top view is a window of its own, left out in headless runs.
+  PoseViewer(size_t historyMemory, const std::string & historyFile, bool topView = true)
+      : _history(historyMemory, historyFile)
+  {
+    if (topView) {
+      _topWindow.reset(new MyGUI::ObjectWindow("OKVIS Top View", imageSize, imageSize));
+      // looking down on the x-y plane, which is x, -z in viewer axes
+      _topWindow->up = Eigen::Vector3d(0, 0, -1);
+      _topWindow->add_object(&_pathTop);
+      _topWindow->add_object(&_axis);
+      _topWindow->add_object(&_hud);
+      fitTopView();
+    }
+  }
+  // shows the ground truth and the errors of the estimates
+  void setEvaluation(const GroundTruth * groundTruth, const TrajectoryEvaluator * evaluator)
+  {
+    _groundTruth = groundTruth;
+    _evaluator = evaluator;
+    if (_topWindow) {
+      _topWindow->add_object(&_groundTruth3d);
+    }
+  }
+  // the draw thread's queue, its depth is shown
+  void setCommandQueue(const CommandQueue * commands)
   {
-    cv::namedWindow("OKVIS Top View");
-    _image.create(imageSize, imageSize, CV_8UC3);
-    drawing_ = false;
-    showing_ = false;
+    _commands = commands;
   }
-  // this we can register as a callback
+  // this we can register as a callback. It runs on the estimator's thread,
+  // so it only hands the state over; everything else happens in display()
   void publishFullStateAsCallback(
-      const okvis::Time & /*t*/, const okvis::kinematics::Transformation & T_WS,
+      const okvis::Time & t, const okvis::kinematics::Transformation & T_WS,
       const Eigen::Matrix<double, 9, 1> & speedAndBiases,
-      const Eigen::Matrix<double, 3, 1> & /*omega_S*/)
+      const Eigen::Matrix<double, 3, 1> & omega_S)
+  {
+    StateRecord state;
+    state.timestamp = int64_t(t.toNSec());
+    Eigen::Map<Eigen::Vector3d>(state.r) = T_WS.r();
+    const Eigen::Quaterniond q = T_WS.q();
+    state.q[0] = q.w(); state.q[1] = q.x(); state.q[2] = q.y(); state.q[3] = q.z();
+    Eigen::Map<Eigen::Matrix<double, 9, 1> >(state.speed_and_biases) = speedAndBiases;
+    Eigen::Map<Eigen::Vector3d>(state.omega) = omega_S;
+    _snapshots.push(state);
+  }
+  void display()
   {
+    // take over every state published since the last frame
+    const size_t queued = _snapshots.size();
+    StateRecord snapshot;
+    bool updated = false;
+    while (_snapshots.pop(snapshot)) {
+      addPose(snapshot);
+      updated = true;
+    }
+    if (updated) {
+      if (_redraw) {
+        redrawPath();
+      }
+      draw(snapshot);
+    }
+    if (_topWindow) {
+      updateHud(queued);
+    }
+    MyGUI::Manager::update();
+  }
+ private:
+  // nodes of the 3d paths before they are thinned out from the history
+  static const size_t maxPathNodes = 100000;
+  // nodes of the top path before it is thinned out anew
+  static const size_t maxTopNodes = 20000;
+  void addPose(const StateRecord & snapshot)
+  {
+    if (!_history.append(snapshot)) {
+      return;  // out of order
+    }
+    Eigen::Map<const Eigen::Vector3d> r(snapshot.r);
+    _path3d.add_node(Eigen::Vector3d(r.x(),r.z(),-r.y()));
 
-    // just append the path
-    Eigen::Vector3d r = T_WS.r();
-    Eigen::Matrix3d C = T_WS.C();
-    _path.push_back(cv::Point2d(r[0], r[1]));
-    _heights.push_back(r[2]);
-    // maintain scaling
-    if (r[0] - _frameScale < _min_x)
-      _min_x = r[0] - _frameScale;
-    if (r[1] - _frameScale < _min_y)
-      _min_y = r[1] - _frameScale;
-    if (r[2] < _min_z)
-      _min_z = r[2];
-    if (r[0] + _frameScale > _max_x)
-      _max_x = r[0] + _frameScale;
-    if (r[1] + _frameScale > _max_y)
-      _max_y = r[1] + _frameScale;
-    if (r[2] > _max_z)
-      _max_z = r[2];
-    _scale = std::min(imageSize / (_max_x - _min_x), imageSize / (_max_y - _min_y));
+    // ground truth at the same time, placed by the alignment in draw()
+    Eigen::Vector3d r_truth;
+    Eigen::Quaterniond q_truth;
+    if (_groundTruth && _groundTruth->interpolate(snapshot.timestamp, r_truth, q_truth)) {
+      _groundTruth3d.add_node(Eigen::Vector3d(r_truth.x(),r_truth.z(),-r_truth.y()));
+    }
 
-    // draw it
-    while (showing_) {
+    if (_path3d.size() > maxPathNodes || _groundTruth3d.size() > maxPathNodes) {
+      rebuildPaths();
     }
-    drawing_ = true;
 
-    _path3d.add_node(Eigen::Vector3d(r.x(),r.z(),-r.y()));
-    _axis.set_transform(Eigen::Translation3d(Eigen::Vector3d(r.x(),r.z(),-r.y()))*Eigen::Quaterniond(C));
-    // erase
-    _image.setTo(cv::Scalar(10, 10, 10));
-    drawPath();
-    // draw axes
-    Eigen::Vector3d e_x = C.col(0);
-    Eigen::Vector3d e_y = C.col(1);
-    Eigen::Vector3d e_z = C.col(2);
-    cv::line(
-        _image,
-        convertToImageCoordinates(_path.back()),
-        convertToImageCoordinates(
-            _path.back() + cv::Point2d(e_x[0], e_x[1]) * _frameScale),
-        cv::Scalar(0, 0, 255), 1, CV_AA);
-    cv::line(
-        _image,
-        convertToImageCoordinates(_path.back()),
-        convertToImageCoordinates(
-            _path.back() + cv::Point2d(e_y[0], e_y[1]) * _frameScale),
-        cv::Scalar(0, 255, 0), 1, CV_AA);
-    cv::line(
-        _image,
-        convertToImageCoordinates(_path.back()),
-        convertToImageCoordinates(
-            _path.back() + cv::Point2d(e_z[0], e_z[1]) * _frameScale),
-        cv::Scalar(255, 0, 0), 1, CV_AA);
-
-    // some text:
-    std::stringstream postext;
-    postext << "position = [" << r[0] << ", " << r[1] << ", " << r[2] << "]";
-    cv::putText(_image, postext.str(), cv::Point(15,15),
-                cv::FONT_HERSHEY_COMPLEX, 0.5, cv::Scalar(255,255,255), 1);
-    std::stringstream veltext;
-    veltext << "velocity = [" << speedAndBiases[0] << ", " << speedAndBiases[1] << ", " << speedAndBiases[2] << "]";
-    cv::putText(_image, veltext.str(), cv::Point(15,35),
-                    cv::FONT_HERSHEY_COMPLEX, 0.5, cv::Scalar(255,255,255), 1);
-
-    drawing_ = false; // notify
+    if (!_topWindow) {
+      return;
+    }
+    const PathLod::Point point = { r[0], r[1], r[2] };
+    _path.add(point);
+    // maintain scaling. The bounds grow with some slack, so the top path
+    // only has to be thinned out anew now and then when it leaves them.
+    const double slack = 0.1 * std::max(_max_x - _min_x, _max_y - _min_y);
+    if (r[0] - _frameScale < _min_x) {
+      _min_x = r[0] - _frameScale - slack;
+      _redraw = true;
+    }
+    if (r[1] - _frameScale < _min_y) {
+      _min_y = r[1] - _frameScale - slack;
+      _redraw = true;
+    }
+    if (r[0] + _frameScale > _max_x) {
+      _max_x = r[0] + _frameScale + slack;
+      _redraw = true;
+    }
+    if (r[1] + _frameScale > _max_y) {
+      _max_y = r[1] + _frameScale + slack;
+      _redraw = true;
+    }
+    _scale = std::min(imageSize / (_max_x - _min_x), imageSize / (_max_y - _min_y));
+
+    // only the new segment is added
+    if (!_redraw) {
+      drawSegment(point);
+      _redraw = _pathTop.size() > maxTopNodes;
+    }
   }
-  void display()
+  // thins out the 3d paths to half the node limit, evenly over the whole history
+  void rebuildPaths()
   {
-    while (drawing_) {
+    std::vector<StateRecord> states;
+    _history.read(std::numeric_limits<int64_t>::min(), std::numeric_limits<int64_t>::max(),
+                  maxPathNodes / 2, states);
+    _path3d.clear();
+    _groundTruth3d.clear();
+    for (const StateRecord & state : states) {
+      _path3d.add_node(Eigen::Vector3d(state.r[0], state.r[2], -state.r[1]));
+      Eigen::Vector3d r_truth;
+      Eigen::Quaterniond q_truth;
+      if (_groundTruth && _groundTruth->interpolate(state.timestamp, r_truth, q_truth)) {
+        _groundTruth3d.add_node(Eigen::Vector3d(r_truth.x(),r_truth.z(),-r_truth.y()));
+      }
     }
-    showing_ = true;
-    MyGUI::Manager::update();
-    cv::imshow("OKVIS Top View", _image);
-    showing_ = false;
-    cv::waitKey(1);
   }
- private:
-  cv::Point2d convertToImageCoordinates(const cv::Point2d & pointInMeters) const
+  void draw(const StateRecord & snapshot)
   {
-    cv::Point2d pt = (pointInMeters - cv::Point2d(_min_x, _min_y)) * _scale;
-    return cv::Point2d(pt.x, imageSize - pt.y); // reverse y for more intuitive top-down plot
+    Eigen::Map<const Eigen::Vector3d> r(snapshot.r);
+    const Eigen::Quaterniond q(snapshot.q[0], snapshot.q[1], snapshot.q[2], snapshot.q[3]);
+    _axis.set_transform(Eigen::Translation3d(Eigen::Vector3d(r.x(),r.z(),-r.y()))*q);
+    _latest = snapshot;
+    _hasLatest = true;
+
+    if (_evaluator) {
+      const TrajectoryEvaluator::Result result = _evaluator->result();
+      // ground truth into the world frame of the estimates, in viewer axes (x, z, -y)
+      Eigen::Matrix3d M;
+      M << 1, 0, 0, 0, 0, 1, 0, -1, 0;
+      Eigen::Affine3d T = Eigen::Affine3d::Identity();
+      T.linear() = M * result.R.transpose() * M.transpose();
+      T.translation() = -M * result.R.transpose() * result.t;
+      _groundTruth3d.set_transform(T);
+      std::stringstream errtext;
+      errtext.precision(3);
+      errtext << std::fixed << "ATE = " << result.ate << " m, RPE = " << result.rpe_translation
+          << " m / " << result.rpe_rotation << " deg";
+      _errorText = errtext.str();
+    }
   }
-  void drawPath()
+  // position, velocity, errors, draw rate and queue depths
+  void updateHud(size_t queued)
   {
-    for (size_t i = 0; i + 1 < _path.size(); ) {
-      cv::Point2d p0 = convertToImageCoordinates(_path[i]);
-      cv::Point2d p1 = convertToImageCoordinates(_path[i + 1]);
-      cv::Point2d diff = p1-p0;
-      if(diff.dot(diff)<2.0){
-        _path.erase(_path.begin() + i + 1);  // clean short segment
-        _heights.erase(_heights.begin() + i + 1);
-        continue;
+    const auto now = std::chrono::steady_clock::now();
+    if (_lastDisplay != std::chrono::steady_clock::time_point()) {
+      const double dt = std::chrono::duration<double>(now - _lastDisplay).count();
+      if (dt > 0.0) {
+        _frameRate = _frameRate > 0.0 ? 0.9 * _frameRate + 0.1 / dt : 1.0 / dt;
       }
-      double rel_height = (_heights[i] - _min_z + _heights[i + 1] - _min_z)
-                      * 0.5 / (_max_z - _min_z);
-      cv::line(
-          _image,
-          p0,
-          p1,
-          rel_height * cv::Scalar(255, 0, 0)
-              + (1.0 - rel_height) * cv::Scalar(0, 0, 255),
-          1, CV_AA);
-      i++;
-    }
-  }
-  cv::Mat _image;
-  std::vector<cv::Point2d> _path;
-  std::vector<double> _heights;
+    }
+    _lastDisplay = now;
+
+    std::stringstream text;
+    text.precision(3);
+    text << std::fixed;
+    if (_hasLatest) {
+      Eigen::Map<const Eigen::Vector3d> r(_latest.r);
+      Eigen::Map<const Eigen::Vector3d> v(_latest.speed_and_biases);
+      text << "position = [" << r[0] << ", " << r[1] << ", " << r[2] << "]\n";
+      text << "velocity = [" << v[0] << ", " << v[1] << ", " << v[2] << "]\n";
+    }
+    if (!_errorText.empty()) {
+      text << _errorText << "\n";
+    }
+    text.precision(1);
+    text << "draw rate = " << _frameRate << " Hz\n";
+    text << "queued states = " << queued << ", dropped = " << _snapshots.dropped();
+    if (_commands) {
+      text << ", commands = " << _commands->size();
+    }
+    _hud.set_text(text.str());
+  }
+  // adds the segment from the last added point, unless it is too short to see
+  void drawSegment(const PathLod::Point & point)
+  {
+    if (_hasDrawn) {
+      const double dx = (point.x - _drawn.x) * _scale;
+      const double dy = (point.y - _drawn.y) * _scale;
+      if (dx * dx + dy * dy < 2.0) {
+        return;  // skip short segment
+      }
+    }
+    _pathTop.add_node(Eigen::Vector3d(point.x, point.z, -point.y));
+    _drawn = point;
+    _hasDrawn = true;
+  }
+  // the whole top path at the detail of the current scale, or evenly
+  // thinned out from the history if that is too many nodes
+  void redrawPath()
+  {
+    _path.polyline(0.5 / _scale, _polyline);  // half a pixel
+    if (_polyline.size() > maxTopNodes / 2) {
+      std::vector<Eigen::Vector3d> positions;
+      _history.read_positions(std::numeric_limits<int64_t>::min(),
+                              std::numeric_limits<int64_t>::max(), maxTopNodes / 2, positions);
+      _polyline.resize(positions.size());
+      for (size_t i = 0; i < positions.size(); ++i) {
+        const PathLod::Point point = { positions[i][0], positions[i][1], positions[i][2] };
+        _polyline[i] = point;
+      }
+    }
+    _pathTop.clear();
+    _hasDrawn = false;
+    for (size_t i = 0; i < _polyline.size(); ++i) {
+      drawSegment(_polyline[i]);
+    }
+    _redraw = false;
+    fitTopView();
+  }
+  // the orthographic top camera over the bounds
+  void fitTopView()
+  {
+    const Eigen::Vector3d center(0.5 * (_min_x + _max_x), 0.0, -0.5 * (_min_y + _max_y));
+    _topWindow->gaze = center;
+    _topWindow->eye = center + Eigen::Vector3d(0, 100, 0);
+    _topWindow->ortho_extent = std::max(_max_x - _min_x, _max_y - _min_y);
+  }
+  MyGUI::Path _pathTop = MyGUI::Path("TopPath", Eigen::Vector3d(1, 0, 0));
+  MyGUI::Text _hud = MyGUI::Text("Hud", 10, 10, 1.5f);
+  PathLod _path;
+  std::vector<PathLod::Point> _polyline;
+  PathLod::Point _drawn;
+  bool _hasDrawn = false;
+  bool _redraw = false;
+  StateRecord _latest;
+  bool _hasLatest = false;
+  std::string _errorText;
+  double _frameRate = 0.0;
+  std::chrono::steady_clock::time_point _lastDisplay;
   double _scale = 1.0;
   double _min_x = -0.5;
   double _min_y = -0.5;
-  double _min_z = -0.5;
   double _max_x = 0.5;
   double _max_y = 0.5;
-  double _max_z = 0.5;
   const double _frameScale = 0.2;  // [m]
-  std::atomic_bool drawing_;
-  std::atomic_bool showing_;
+  const GroundTruth * _groundTruth = nullptr;
+  const TrajectoryEvaluator * _evaluator = nullptr;
+  const CommandQueue * _commands = nullptr;
+  // states from the estimator's thread, drained by display()
+  SnapshotQueue<StateRecord, 4096> _snapshots;
+  // every state shown, in bounded memory
+  StateHistory _history;
+  // after the objects it shows
+  std::unique_ptr<MyGUI::ObjectWindow> _topWindow;
 };
 
+// pinhole camera of the transformed frames, same distortion as the original one
+template<class Distortion>
+static std::shared_ptr<const okvis::cameras::CameraBase> transformedCamera(
+    const okvis::cameras::CameraBase& camera, const FrameTransform& transform) {
+  Eigen::VectorXd intrinsics;
+  camera.getIntrinsics(intrinsics);
+  const int width = camera.imageWidth();
+  const int height = camera.imageHeight();
+  transform.transform_intrinsics(width, height, intrinsics[0], intrinsics[1],
+                                 intrinsics[2], intrinsics[3]);
+  const cv::Size size = transform.output_size(width, height);
+  std::shared_ptr<okvis::cameras::PinholeCamera<Distortion> > transformed(
+      new okvis::cameras::PinholeCamera<Distortion>(
+          size.width, size.height, intrinsics[0], intrinsics[1], intrinsics[2],
+          intrinsics[3], Distortion()));
+  transformed->setIntrinsics(intrinsics);  // distortion coefficients
+  return transformed;
+}
+
+// rebuilds the camera system for frames which went through the transforms
+static void transformCameraSystem(okvis::cameras::NCameraSystem& cameras,
+                                  const std::vector<FrameTransform>& transforms) {
+  typedef okvis::cameras::NCameraSystem NCameraSystem;
+  NCameraSystem transformed;
+  for (size_t i = 0; i < cameras.numCameras(); ++i) {
+    const okvis::cameras::CameraBase& camera = *cameras.cameraGeometry(i);
+    std::shared_ptr<const okvis::cameras::CameraBase> geometry;
+    switch (cameras.distortionType(i)) {
+      case NCameraSystem::Equidistant:
+        geometry = transformedCamera<okvis::cameras::EquidistantDistortion>(camera, transforms[i]);
+        break;
+      case NCameraSystem::RadialTangential:
+        geometry = transformedCamera<okvis::cameras::RadialTangentialDistortion>(camera, transforms[i]);
+        break;
+      case NCameraSystem::RadialTangential8:
+        geometry = transformedCamera<okvis::cameras::RadialTangentialDistortion8>(camera, transforms[i]);
+        break;
+      default:
+        geometry = transformedCamera<okvis::cameras::NoDistortion>(camera, transforms[i]);
+        break;
+    }
+    transformed.addCamera(cameras.T_SC(i), geometry, cameras.distortionType(i));
+  }
+  cameras = transformed;
+}
+
 // this is just a workbench. most of the stuff here will go into the Frontend class.
 int main(int argc, char **argv)
 {
@@ -210,199 +422,561 @@ int main(int argc, char **argv)
   FLAGS_stderrthreshold = 0;  // INFO: 0, WARNING: 1, ERROR: 2, FATAL: 3
   FLAGS_colorlogtostderr = 1;
 
-  if (argc != 3 && argc != 4) {
+  // split positional arguments from --option=value flags
+  std::vector<std::string> args;
+  std::map<std::string, std::string> options;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg(argv[i]);
+    if (arg.compare(0, 2, "--") == 0) {
+      size_t eq = arg.find('=');
+      options[arg.substr(2, eq == std::string::npos ? std::string::npos : eq - 2)] =
+          eq == std::string::npos ? "" : arg.substr(eq + 1);
+    } else {
+      args.push_back(arg);
+    }
+  }
+
+  // run a list of (configuration, dataset) jobs, each in its own process.
+  // Every job keeps several threads busy, so by default they share the cores.
+  if (options.count("batch")) {
+    const size_t workers = options.count("jobs") ?
+        std::max(1, atoi(options["jobs"].c_str())) : std::max(1u, std::thread::hardware_concurrency() / 4);
+    const std::string outputDir = options.count("output") ? options["output"] : "batch_output";
+    std::vector<std::string> jobArgs;
+    for (int i = 1; i < argc; ++i) {
+      std::string arg(argv[i]);
+      if (arg.compare(0, 2, "--") == 0 && arg.compare(0, 8, "--batch=") != 0 &&
+          arg.compare(0, 7, "--jobs=") != 0 && arg.compare(0, 9, "--output=") != 0) {
+        jobArgs.push_back(arg);
+      }
+    }
+    const std::string executable =
+        boost::filesystem::exists("/proc/self/exe") ?
+        boost::filesystem::read_symlink("/proc/self/exe").string() : std::string(argv[0]);
+    return BatchRunner::run(executable, options["batch"], outputDir, workers, jobArgs) == 0 ? 0 : -1;
+  }
+
+  if (args.size() != 2 && args.size() != 3) {
     LOG(ERROR)<<
-    "Usage: ./" << argv[0] << " configuration-yaml-file dataset-folder [skip-first-seconds]";
+    "Usage: ./" << argv[0] << " configuration-yaml-file dataset-folder [skip-first-seconds]"
+    " [--end-seconds=T] [--prefetch-workers=N] [--prefetch-depth=N] [--replay=RATE|max]"
+    " [--headless] [--trajectory=FILE] [--trajectory-format=euroc|tum(pose only)|binary]"
+    " [--frame-cache=DIR] [--frame-cache-size=GB] [--ground-truth=FILE]"
+    " [--history-memory=MB] [--history-file=FILE] [--overlay] [--refresh-rate=HZ]"
+    " [--record=DIR] [--record-interval=S]"
+    " [--decoder=opencv|stb] [--reduce=N[,N]] [--roi=x:y:w:h[,x:y:w:h]] [--bin=N[,N]]\n"
+    "       ./" << argv[0] << " --batch=jobs-file [--jobs=N] [--output=DIR] [options]";
     return -1;
   }
 
-  okvis::Duration deltaT(0.0);
-  if (argc == 4) {
-    deltaT = okvis::Duration(atof(argv[3]));
+  // playback window relative to the first frame [ns]
+  int64_t skipNs = 0;
+  int64_t endNs = std::numeric_limits<int64_t>::max();
+  if (args.size() == 3) {
+    skipNs = int64_t(atof(args[2].c_str()) * 1e9);
+  }
+  if (options.count("end-seconds")) {
+    endNs = int64_t(atof(options["end-seconds"].c_str()) * 1e9);
   }
 
-  if (!MyGUI::Manager::init())
+  // image decoding runs ahead of the estimator on a pool of workers
+  size_t prefetchWorkers = std::max(2u, std::thread::hardware_concurrency() / 2);
+  size_t prefetchDepth = 8;
+  if (options.count("prefetch-workers")) {
+    prefetchWorkers = std::max(1, atoi(options["prefetch-workers"].c_str()));
+  }
+  if (options.count("prefetch-depth")) {
+    prefetchDepth = std::max(1, atoi(options["prefetch-depth"].c_str()));
+  }
+
+  // backend for PNG and JPEG frames
+  if (options.count("decoder")) {
+    ImageDecoder::set_default_backend(
+        options["decoder"] == "stb" ? ImageDecoder::kStb : ImageDecoder::kOpenCV);
+  }
+
+  // replay on a wall clock with a non-blocking estimator, like a live sensor.
+  // Without --replay every message is fed blocking, as fast as it is processed.
+  const bool replay = options.count("replay") > 0;
+  ReplayClock replayClock(
+      !replay || options["replay"] == "max" ? 0.0 : atof(options["replay"].c_str()));
+  ReplayMonitor replayMonitor(replayClock);
+
+  // without any windows the run ends with the dataset
+  const bool headless = options.count("headless") > 0;
+
+  // PNG snapshots of the path view, in a headless run drawn offscreen
+  const bool recordFrames = options.count("record") > 0;
+  const bool drawing = !headless || recordFrames;
+
+  // every published state is recorded, always in a headless run
+  const bool recordTrajectory = headless || options.count("trajectory") > 0;
+  const std::string trajectoryFilename =
+      options.count("trajectory") ? options["trajectory"] : "trajectory.csv";
+  TrajectoryWriter::Format trajectoryFormat = TrajectoryWriter::format_for(trajectoryFilename);
+  if (options.count("trajectory-format")) {
+    const std::string& format = options["trajectory-format"];
+    if (format == "euroc") {
+      trajectoryFormat = TrajectoryWriter::kEuroc;
+    } else if (format == "tum") {
+      trajectoryFormat = TrajectoryWriter::kTum;
+    } else if (format == "binary") {
+      trajectoryFormat = TrajectoryWriter::kBinary;
+    } else {
+      LOG(ERROR)<< "Unknown trajectory format " << format;
+      return -1;
+    }
+  }
+
+  if (drawing && !MyGUI::Manager::init())
   {
       fprintf(stdout, "Failed to initialize GLFW\n");
       return -1;
   }
 
   // read configuration file
-  std::string configFilename(argv[1]);
+  std::string configFilename(args[0]);
 
   okvis::VioParametersReader vio_parameters_reader(configFilename);
   okvis::VioParameters parameters;
   vio_parameters_reader.getParameters(parameters);
+  if (replay) {
+    // one state per processed frame, so dropped frames can be counted
+    parameters.publishing.publishImuPropagatedState = false;
+  }
+  if (headless) {
+    parameters.visualization.displayImages = false;
+  }
+  // the camera images go to GL windows, the estimator's OpenCV overlay
+  // with its per frame copies only on request
+  const bool cameraWindows = parameters.visualization.displayImages && !options.count("overlay");
+  if (cameraWindows) {
+    parameters.visualization.displayImages = false;
+  }
 
-  okvis::ThreadedKFVio okvis_estimator(parameters);
-
-  PoseViewer poseViewer;
-  MyGUI::CameraWindow path_win("Path Viewer", 1024, 620);
-  MyGUI::Axis axis1("axis1", 1);
-  MyGUI::Grid grid1("grid1", 30, 1);
-  path_win.add_object(&grid1);
-  path_win.add_object(&axis1);
-  path_win.add_object(&(poseViewer._axis));
-  path_win.add_object(&(poseViewer._path3d));
-  okvis_estimator.setFullStateCallback(
-      std::bind(&PoseViewer::publishFullStateAsCallback, &poseViewer,
-                std::placeholders::_1, std::placeholders::_2,
-                std::placeholders::_3, std::placeholders::_4));
-
-  okvis_estimator.setBlocking(true);
-
-  // the folder path
-  std::string path(argv[2]);
+  // the dataset folder or packed dataset file
+  std::string path(args[1]);
 
   const unsigned int numCameras = parameters.nCameraSystem.numCameras();
 
-  // open the IMU file
-  std::string line;
-  std::ifstream imu_file(path + "/imu0/data.csv");
-  if (!imu_file.good()) {
-    LOG(ERROR)<< "no imu file found at " << path+"/imu0/data.csv";
+  // lower resolution input, the estimator gets matching intrinsics
+  std::vector<FrameTransform> transforms;
+  if (!FrameTransform::parse(numCameras, options["reduce"], options["roi"], options["bin"],
+                             transforms)) {
+    LOG(ERROR)<< "Invalid --reduce, --roi or --bin";
     return -1;
   }
-  int number_of_lines = 0;
-  while (std::getline(imu_file, line))
-    ++number_of_lines;
-  LOG(INFO)<< "No. IMU measurements: " << number_of_lines-1;
-  if (number_of_lines - 1 <= 0) {
-    LOG(ERROR)<< "no imu messages present in " << path+"/imu0/data.csv";
-    return -1;
+  std::vector<cv::Size> fullSizes;
+  bool transformed = false;
+  std::string transformKey;
+  for (size_t i = 0; i < numCameras; ++i) {
+    fullSizes.push_back(cv::Size(parameters.nCameraSystem.cameraGeometry(i)->imageWidth(),
+                                 parameters.nCameraSystem.cameraGeometry(i)->imageHeight()));
+    if (!transforms[i].fits(fullSizes[i].width, fullSizes[i].height)) {
+      const cv::Rect& roi = transforms[i].roi;
+      LOG(ERROR)<< "--roi " << roi.x << ":" << roi.y << ":" << roi.width << ":" << roi.height
+          << " of camera " << i << " does not fit its " << fullSizes[i].width << "x"
+          << fullSizes[i].height << " frames at the given --reduce and --bin";
+      return -1;
+    }
+    transformed = transformed || !transforms[i].identity();
+    transformKey += (i ? "," : "") + transforms[i].key();
+  }
+  if (transformed) {
+    transformCameraSystem(parameters.nCameraSystem, transforms);
   }
-  // set reading position to second line
-  imu_file.clear();
-  imu_file.seekg(0, std::ios::beg);
-  std::getline(imu_file, line);
 
-  std::vector<okvis::Time> times;
-  okvis::Time latest(0);
-  int num_camera_images = 0;
-  std::vector < std::vector < std::string >> image_names(numCameras);
+  // opened before the estimator, which may still hold images pointing into it
+  std::unique_ptr<Dataset> dataset;
+  try {
+    dataset = Dataset::open(path, numCameras);
+    if (transformed) {
+      dataset.reset(new TransformedDataset(std::move(dataset), transforms, fullSizes));
+    }
+    if (options.count("frame-cache")) {
+      // decoded frames are kept on disk for the next run over this dataset
+      const double cacheSize = options.count("frame-cache-size") ?
+          atof(options["frame-cache-size"].c_str()) : 16.0;
+      dataset.reset(new CachedDataset(std::move(dataset), path, options["frame-cache"],
+                                      uint64_t(cacheSize * 1024 * 1024 * 1024),
+                                      transformed ? transformKey : std::string()));
+    }
+  } catch (const std::exception& e) {
+    LOG(ERROR)<< e.what();
+    return -1;
+  }
+  LOG(INFO)<< "No. IMU measurements: " << dataset->imu_size();
   for (size_t i = 0; i < numCameras; ++i) {
-    num_camera_images = 0;
-    std::string folder(path + "/cam" + std::to_string(i) + "/data");
-
-    for (auto it = boost::filesystem::directory_iterator(folder);
-        it != boost::filesystem::directory_iterator(); it++) {
-      if (!boost::filesystem::is_directory(it->path())) {  //we eliminate directories
-        num_camera_images++;
-        image_names.at(i).push_back(it->path().filename().string());
-      } else {
-        continue;
-      }
+    LOG(INFO)<< "No. cam " << i << " images: " << dataset->num_frames(i);
+  }
+  const ImuSample* imu_samples = dataset->imu_data();
+
+  // outlives the estimator, so every state it publishes is written
+  std::unique_ptr<TrajectoryWriter> trajectoryWriter;
+  if (recordTrajectory) {
+    try {
+      trajectoryWriter.reset(new TrajectoryWriter(trajectoryFilename, trajectoryFormat));
+    } catch (const std::exception& e) {
+      LOG(ERROR)<< e.what();
+      return -1;
     }
+  }
+  std::atomic<int64_t> latestState(0);
 
-    if (num_camera_images == 0) {
-      LOG(ERROR)<< "no images at " << folder;
-      return 1;
+  // ground truth of the dataset folder, or given explicitly for packed datasets
+  std::string groundTruthFilename = path + "/state_groundtruth_estimate0/data.csv";
+  if (options.count("ground-truth")) {
+    groundTruthFilename = options["ground-truth"];
+  }
+  std::unique_ptr<GroundTruth> groundTruth;
+  std::unique_ptr<TrajectoryEvaluator> evaluator;
+  if (options.count("ground-truth") || boost::filesystem::is_regular_file(groundTruthFilename)) {
+    try {
+      groundTruth.reset(new GroundTruth(groundTruthFilename));
+    } catch (const std::exception& e) {
+      LOG(ERROR)<< e.what();
+      return -1;
     }
-
-    LOG(INFO)<< "No. cam " << i << " images: " << num_camera_images;
-    // the filenames are not going to be sorted. So do this here
-    std::sort(image_names.at(i).begin(), image_names.at(i).end());
+    evaluator.reset(new TrajectoryEvaluator(*groundTruth));
+    LOG(INFO)<< "No. ground truth poses: " << groundTruth->size();
   }
 
-  std::vector < std::vector < std::string > ::iterator
-      > cam_iterators(numCameras);
-  for (size_t i = 0; i < numCameras; ++i) {
-    cam_iterators.at(i) = image_names.at(i).begin();
-  }
-
-  int counter = 0;
-  okvis::Time start(0.0);
-
-  bool cont_flag = false;
-  while (true && MyGUI::Manager::running()) {
-    poseViewer.display();
-    if(cont_flag)
-      continue;
-    okvis_estimator.display();
-
-    // check if at the end
-    for (size_t i = 0; i < numCameras; ++i) {
-      if (cam_iterators[i] == image_names[i].end()) {
-        //std::cout << std::endl << "Finished. Press any key to exit." << std::endl << std::flush;
-        //cv::waitKey();
-        //return 0;
-        cont_flag=true;
+  // scene updates for the thread drawing the windows, outlives the
+  // estimator's threads posting them
+  CommandQueue renderCommands;
+
+  // the viewers outlive the estimator too, its publisher thread calls
+  // into them until the estimator is destroyed
+  std::unique_ptr<PoseViewer> poseViewer;
+  std::unique_ptr<PngSequenceWriter> frameRecorder;
+  std::unique_ptr<MyGUI::CameraWindow> path_win;
+  MyGUI::Axis axis1("axis1", 1);
+  MyGUI::Grid grid1("grid1", 30, 1);
+  MyGUI::PointCloud landmarkCloud("landmarks", Eigen::Vector3d(1.0, 1.0, 0.6));
+  if (drawing) {
+    // state history of the viewers, 64 MB on the heap unless set otherwise
+    const double historyMemory = options.count("history-memory") ?
+        atof(options["history-memory"].c_str()) : 64.0;
+    try {
+      poseViewer.reset(new PoseViewer(size_t(historyMemory * 1024 * 1024),
+                                      options.count("history-file") ? options["history-file"] : "",
+                                      !headless));
+      if (recordFrames) {
+        frameRecorder.reset(new PngSequenceWriter(options["record"]));
       }
+    } catch (const std::exception& e) {
+      LOG(ERROR)<< e.what();
+      return -1;
     }
-    if(cont_flag)
-      continue;
-
-    /// add images
-    okvis::Time t;
-
-    for (size_t i = 0; i < numCameras; ++i) {
-      cv::Mat filtered = cv::imread(
-          path + "/cam" + std::to_string(i) + "/data/" + *cam_iterators.at(i),
-          cv::IMREAD_GRAYSCALE);
-      std::string nanoseconds = cam_iterators.at(i)->substr(
-          cam_iterators.at(i)->size() - 13, 9);
-      std::string seconds = cam_iterators.at(i)->substr(
-          0, cam_iterators.at(i)->size() - 13);
-      t = okvis::Time(std::stoi(seconds), std::stoi(nanoseconds));
-      if (start == okvis::Time(0.0)) {
-        start = t;
-      }
-
-      // get all IMU measurements till then
-      okvis::Time t_imu = start;
-      do {
-        if (!std::getline(imu_file, line)) {
-          //std::cout << std::endl << "Finished. Press any key to exit." << std::endl << std::flush;
-          //cv::waitKey();
-          cont_flag=true;
-          break;//return 0;
-        }
+    poseViewer->setCommandQueue(&renderCommands);
+    path_win.reset(new MyGUI::CameraWindow("Path Viewer", 1024, 620, !headless));
+    if (path_win->win_ptr == NULL || (headless && !path_win->set_offscreen(1024, 620))) {
+      LOG(ERROR)<< "Cannot draw the path view, a headless --record needs a display"
+          " (e.g. Xvfb) and framebuffer objects";
+      return -1;
+    }
+    if (frameRecorder) {
+      path_win->on_capture = [&frameRecorder](int width, int height, std::vector<unsigned char>& rgb) {
+        frameRecorder->push(width, height, 3, std::move(rgb), true);
+      };
+    }
+    path_win->add_object(&grid1);
+    path_win->add_object(&axis1);
+    path_win->add_object(&landmarkCloud);
+    path_win->add_object(&(poseViewer->_axis));
+    path_win->add_object(&(poseViewer->_path3d));
+    if (evaluator) {
+      poseViewer->setEvaluation(groundTruth.get(), evaluator.get());
+      path_win->add_object(&(poseViewer->_groundTruth3d));
+    }
+  }
 
-        std::stringstream stream(line);
-        std::string s;
-        std::getline(stream, s, ',');
-        std::string nanoseconds = s.substr(s.size() - 9, 9);
-        std::string seconds = s.substr(0, s.size() - 9);
+  okvis::ThreadedKFVio okvis_estimator(parameters);
 
-        Eigen::Vector3d gyr;
-        for (int j = 0; j < 3; ++j) {
-          std::getline(stream, s, ',');
-          gyr[j] = std::stof(s);
+  std::vector<std::unique_ptr<MyGUI::ImageWindow> > cameraWins(numCameras);
+  if (drawing) {
+    // the landmarks in the estimator's window and those marginalized out,
+    // both update the cloud by id
+    const double qualityThreshold = parameters.publishing.landmarkQualityThreshold;
+    okvis_estimator.setLandmarksCallback(
+        [&renderCommands, &landmarkCloud, qualityThreshold](
+            const okvis::Time &, const okvis::MapPointVector & landmarks,
+            const okvis::MapPointVector & transferredLandmarks) {
+          MYPROFILE(landmarks_callback)
+          typedef std::vector<std::pair<uint64_t, Eigen::Vector3d> > Updates;
+          std::shared_ptr<Updates> updates = std::make_shared<Updates>();
+          updates->reserve(landmarks.size() + transferredLandmarks.size());
+          for (const okvis::MapPointVector* points : { &landmarks, &transferredLandmarks }) {
+            for (const okvis::MapPoint & landmark : *points) {
+              // homogeneous, points at infinity are left out
+              if (landmark.quality < qualityThreshold || std::fabs(landmark.point[3]) < 1e-10) {
+                continue;
+              }
+              updates->push_back(std::make_pair(
+                  landmark.id, Eigen::Vector3d(landmark.point.head<3>() / landmark.point[3])));
+            }
+          }
+          renderCommands.push([&landmarkCloud, updates]() {
+            for (const auto & update : *updates) {
+              landmarkCloud.update(update.first, update.second);
+            }
+          });
+        });
+  }
+  okvis_estimator.setFullStateCallback(
+      [&](const okvis::Time & t, const okvis::kinematics::Transformation & T_WS,
+          const Eigen::Matrix<double, 9, 1> & speedAndBiases,
+          const Eigen::Matrix<double, 3, 1> & omega_S) {
+        MYPROFILE(full_state_callback)
+        if (replay) {
+          replayMonitor.published(int64_t(t.toNSec()));
         }
-
-        Eigen::Vector3d acc;
-        for (int j = 0; j < 3; ++j) {
-          std::getline(stream, s, ',');
-          acc[j] = std::stof(s);
+        if (trajectoryWriter) {
+          StateRecord state;
+          state.timestamp = int64_t(t.toNSec());
+          Eigen::Map<Eigen::Vector3d>(state.r) = T_WS.r();
+          const Eigen::Quaterniond q = T_WS.q();
+          state.q[0] = q.w(); state.q[1] = q.x(); state.q[2] = q.y(); state.q[3] = q.z();
+          Eigen::Map<Eigen::Matrix<double, 9, 1> >(state.speed_and_biases) = speedAndBiases;
+          Eigen::Map<Eigen::Vector3d>(state.omega) = omega_S;
+          trajectoryWriter->push(state);
+        }
+        if (evaluator) {
+          evaluator->add(int64_t(t.toNSec()), T_WS.r(), T_WS.q());
         }
+        if (poseViewer) {
+          poseViewer->publishFullStateAsCallback(t, T_WS, speedAndBiases, omega_S);
+        }
+        latestState = int64_t(t.toNSec());
+      });
 
-        t_imu = okvis::Time(std::stoi(seconds), std::stoi(nanoseconds));
+  okvis_estimator.setBlocking(!replay);
 
-        // add the IMU measurement for (blocking) processing
-        if (t_imu - start + okvis::Duration(1.0) > deltaT) {
-          okvis_estimator.addImuMeasurement(t_imu, acc, gyr);
+  // seek to the requested window, nothing before it is read or decoded.
+  // IMU measurements start 1s earlier to initialize the estimator.
+  int64_t startNs = std::numeric_limits<int64_t>::max();
+  for (size_t i = 0; i < numCameras; ++i) {
+    startNs = std::min(startNs, dataset->frame_timestamp(i, 0));
+  }
+  std::vector<size_t> first_frames(numCameras), end_frames(numCameras);
+  for (size_t i = 0; i < numCameras; ++i) {
+    first_frames[i] = dataset->find_frame(i, startNs + skipNs + 1);
+    end_frames[i] = dataset->num_frames(i);
+    if (endNs < std::numeric_limits<int64_t>::max() - startNs) {
+      end_frames[i] = std::max(first_frames[i], dataset->find_frame(i, startNs + endNs + 1));
+    }
+  }
+  const size_t imu_begin = dataset->find_imu(startNs + skipNs - 1000000000 + 1);
+
+  // merge all cameras and the IMU into time ordered multiframes
+  std::vector<Multiframe> schedule;
+  SensorScheduler scheduler(
+      *dataset, first_frames, end_frames, imu_begin,
+      int64_t(parameters.sensors_information.frameTimestampTolerance * 1e9));
+  Multiframe multiframe;
+  while (scheduler.next(multiframe)) {
+    schedule.push_back(multiframe);
+  }
+  const size_t num_frames = schedule.size();
+  LOG(INFO)<< "Playing " << num_frames << " multiframes";
+
+  ImagePrefetcher prefetcher(
+      num_frames, numCameras,
+      [&dataset, &schedule](size_t frame, size_t cam) {
+        const size_t index = schedule[frame].frames[cam];
+        if (index == SensorScheduler::kNoFrame) {
+          return cv::Mat();
         }
+        return dataset->load_image(cam, index);
+      },
+      prefetchWorkers, prefetchDepth);
+  size_t counter = 0;
+  int64_t lastFed = 0;
+  const auto wallStart = std::chrono::steady_clock::now();
+
+  std::atomic<bool> stopFeeding(false);
+  std::atomic<bool> feedDone(false);
+
+  // feeds the dataset to the estimator, never waits for the windows
+  auto feed = [&]() {
+    std::vector<cv::Mat> images(numCameras);
+    std::vector<std::string> errors(numCameras);
+    size_t imu_index = imu_begin;
+    while (!stopFeeding && prefetcher.pop(images, &errors)) {
+      MYPROFILE(feed_multiframe)
+      const Multiframe& current = schedule[counter];
+
+      // add all IMU measurements till then for (blocking) processing
+      for (; imu_index < current.imu_end; ++imu_index) {
+        const ImuSample& sample = imu_samples[imu_index];
+        Eigen::Vector3d gyr(sample.gyro[0], sample.gyro[1], sample.gyro[2]);
+        Eigen::Vector3d acc(sample.acc[0], sample.acc[1], sample.acc[2]);
+        okvis::Time t_imu(sample.timestamp / 1000000000, sample.timestamp % 1000000000);
+        if (replay) {
+          replayClock.wait_until(sample.timestamp);
+          replayClock.released(sample.timestamp);
+        }
+        okvis_estimator.addImuMeasurement(t_imu, acc, gyr);
+      }
 
-      } while (t_imu <= t);
+      /// add images
+      for (size_t i = 0; i < numCameras; ++i) {
+        if (current.frames[i] == SensorScheduler::kNoFrame) {
+          continue;
+        }
+        const int64_t stamp = dataset->frame_timestamp(i, current.frames[i]);
+        if (images[i].empty()) {
+          LOG(WARNING)<< "skipping unreadable frame " << stamp << " of camera " << i
+              << (errors[i].empty() ? std::string() : ": " + errors[i]);
+          continue;
+        }
+        okvis::Time t(stamp / 1000000000, stamp % 1000000000);
+        if (replay) {
+          replayClock.wait_until(stamp);
+          replayClock.released(stamp);
+        }
 
-      // add the image to the frontend for (blocking) processing
-      if (t - start > deltaT) {
-        okvis_estimator.addImage(t, i, filtered);
+        // add the image to the frontend for (blocking) processing
+        okvis_estimator.addImage(t, i, images[i]);
+
+        // shares the pixels, the window uploads them on its next frame
+        if (cameraWindows) {
+          std::shared_ptr<cv::Mat> frame = std::make_shared<cv::Mat>(images[i]);
+          renderCommands.push([&cameraWins, i, frame]() {
+            if (!cameraWins[i]) {
+              std::stringstream name;
+              name << "Camera " << i;
+              cameraWins[i].reset(new MyGUI::ImageWindow(
+                  name.str(), frame->cols, frame->rows,
+                  frame->channels() == 3 ? GL_BGR : GL_LUMINANCE, GL_UNSIGNED_BYTE));
+            }
+            cameraWins[i]->set_image(frame);
+          });
+        }
+      }
+      if (replay) {
+        replayMonitor.fed();
+      }
+      lastFed = current.timestamp;
+      ++counter;
+
+      // display progress
+      if (counter % 20 == 0) {
+        std::cout << "\rProgress: "
+            << int(double(counter) / double(num_frames) * 100) << "%  "
+            << std::flush;
+      }
+    }
+    feedDone = true;
+    if (stopFeeding) {
+      return;
+    }
+    if (evaluator && !headless) {
+      evaluator->print_results();
+    }
+  };
+
+  if (!drawing) {
+    feed();
+  } else {
+    // GLFW handles windows and events on the main thread only, so the
+    // feeding moves to its own thread and the windows are drawn here
+    std::thread feeder(feed);
+    const double refreshRate = options.count("refresh-rate") ?
+        std::max(1.0, atof(options["refresh-rate"].c_str())) : 30.0;
+    const auto framePeriod = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(1.0 / refreshRate));
+    const auto recordPeriod = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(options.count("record-interval") ?
+            std::max(0.0, atof(options["record-interval"].c_str())) : 1.0));
+    auto nextFrame = std::chrono::steady_clock::now();
+    auto nextCapture = nextFrame;
+    // a headless run draws until the dataset is fed
+    while (MyGUI::Manager::running() && !(headless && feedDone)) {
+      {
+        MYPROFILE(draw_frame)
+        renderCommands.run();
+        if (frameRecorder && nextFrame >= nextCapture) {
+          path_win->capture();
+          nextCapture += recordPeriod;
+        }
+        poseViewer->display();
+        if (!headless) {
+          okvis_estimator.display();
+        }
       }
 
-      cam_iterators[i]++;
+      // handle input until the next frame is due, late frames are not caught up
+      nextFrame += framePeriod;
+      auto now = std::chrono::steady_clock::now();
+      if (nextFrame < now) {
+        nextFrame = now;
+      }
+      while (now < nextFrame) {
+        MyGUI::Manager::wait_events(std::chrono::duration<double>(nextFrame - now).count());
+        now = std::chrono::steady_clock::now();
+      }
     }
-    ++counter;
+    stopFeeding = true;
+    feeder.join();
+  }
+
+  std::cout << std::endl << std::flush;
 
-    // display progress
-    if (counter % 20 == 0) {
-      std::cout << "\rProgress: "
-          << int(double(counter) / double(num_camera_images) * 100) << "%  "
-          << std::flush;
+  if (headless || replay) {
+    // let the estimator finish the frames in flight, i.e. until the last
+    // frame's state arrived or nothing was published for a second
+    int64_t seen = latestState;
+    auto lastChange = std::chrono::steady_clock::now();
+    while (latestState < lastFed &&
+        std::chrono::steady_clock::now() - lastChange < std::chrono::seconds(1)) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      if (latestState != seen) {
+        seen = latestState;
+        lastChange = std::chrono::steady_clock::now();
+      }
     }
+  }
+  // frames still queued when feeding ended count as processed or dropped only now
+  if (replay) {
+    replayMonitor.print_results();
+  }
 
+  // also when the windows were closed early, reporting errors and drops
+  const uint64_t statesPublished = trajectoryWriter ? trajectoryWriter->size() : 0;
+  if (trajectoryWriter && !trajectoryWriter->close()) {
+    LOG(ERROR)<< "failed to write " << trajectoryFilename;
+    return -1;
   }
 
-  std::cout << std::endl << std::flush;
+  if (headless) {
+    if (frameRecorder) {
+      // the complete trajectory as the last frame
+      renderCommands.run();
+      path_win->capture();
+      poseViewer->display();
+      path_win->finish_capture();
+      frameRecorder->close();
+    }
+    const double wallTime = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - wallStart).count();
+
+    const double sensorTime = counter > 0 ? (lastFed - schedule[0].timestamp) * 1e-9 : 0.0;
+    printf("\n--------------------------------------------------------------------\n");
+    printf("Multiframes fed:   %14zu\n", counter);
+    printf("States published:  %14llu\n", (unsigned long long)statesPublished);
+    printf("Wall time [s]:     %14.3f\n", wallTime);
+    printf("Throughput [Hz]:   %14.3f\n", counter / wallTime);
+    printf("Real time factor:  %14.3f\n", sensorTime / wallTime);
+    printf("Trajectory:        %s\n", trajectoryFilename.c_str());
+    if (frameRecorder) {
+      printf("Frames recorded:   %14llu\n", (unsigned long long)frameRecorder->written());
+    }
+    printf("--------------------------------------------------------------------\n");
+    if (evaluator) {
+      evaluator->print_results();
+    }
+  }
+  ProfileManager::printResults();
   return 0;
 }
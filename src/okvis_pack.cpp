@@ -0,0 +1,128 @@
+/**
+ * @file okvis_pack.cpp
+ * @brief Converts an ASL/EuRoC dataset folder into a single packed dataset file.
+
+ The packed file can be passed to okvis_driver instead of the dataset folder.
+ Frames are stored in time order, either as the original compressed files or
+ decoded to raw 8 bit grayscale (--raw), which avoids any decoding on playback.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <tuple>
+#include <stdexcept>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wnon-virtual-dtor"
+#pragma GCC diagnostic ignored "-Woverloaded-virtual"
+#include <opencv2/opencv.hpp>
+#pragma GCC diagnostic pop
+
+#include <boost/filesystem.hpp>
+#include <glog/logging.h>
+
+#include "util/packed_dataset.hpp"
+
+int main(int argc, char **argv)
+{
+  google::InitGoogleLogging(argv[0]);
+  FLAGS_stderrthreshold = 0;  // INFO: 0, WARNING: 1, ERROR: 2, FATAL: 3
+  FLAGS_colorlogtostderr = 1;
+
+  std::vector<std::string> args;
+  bool raw = false;
+  size_t numCameras = 0;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg(argv[i]);
+    if (arg == "--raw") {
+      raw = true;
+    } else if (arg.compare(0, 10, "--cameras=") == 0) {
+      numCameras = atoi(arg.substr(10).c_str());
+    } else {
+      args.push_back(arg);
+    }
+  }
+
+  if (args.size() != 2) {
+    LOG(ERROR)<<
+    "Usage: ./" << argv[0] << " dataset-folder output-file [--raw] [--cameras=N]";
+    return -1;
+  }
+  const std::string path(args[0]);
+
+  // by default take every camN folder there is
+  if (numCameras == 0) {
+    while (boost::filesystem::is_directory(
+        path + "/cam" + std::to_string(numCameras) + "/data")) {
+      ++numCameras;
+    }
+  }
+
+  // a failed conversion removes its partial output
+  bool created = false;
+  try {
+    AslDataset dataset(path, numCameras);
+    PackedDatasetWriter writer(args[1], numCameras);
+    created = true;
+
+    writer.add_imu(dataset.imu_data(), dataset.imu_size());
+    LOG(INFO)<< "No. IMU measurements: " << dataset.imu_size();
+
+    // store the frames of all cameras in time order
+    std::vector<std::tuple<int64_t, size_t, size_t> > frames;
+    for (size_t i = 0; i < numCameras; ++i) {
+      LOG(INFO)<< "No. cam " << i << " images: " << dataset.num_frames(i);
+      for (size_t j = 0; j < dataset.num_frames(i); ++j) {
+        frames.push_back(std::make_tuple(dataset.frame_timestamp(i, j), i, j));
+      }
+    }
+    std::sort(frames.begin(), frames.end());
+
+    std::vector<char> buffer;
+    size_t counter = 0;
+    for (const auto& frame : frames) {
+      const size_t cam = std::get<1>(frame);
+      const size_t index = std::get<2>(frame);
+      if (raw) {
+        cv::Mat image = dataset.load_image(cam, index);
+        if (image.empty()) {
+          throw std::runtime_error("cannot decode " + dataset.image_path(cam, index));
+        }
+        if (!image.isContinuous()) {
+          image = image.clone();
+        }
+        writer.add_frame(cam, std::get<0>(frame), Packed::kRaw, image.rows, image.cols,
+                         image.ptr(), image.total());
+      } else {
+        std::ifstream file(dataset.image_path(cam, index), std::ios::binary | std::ios::ate);
+        if (!file.good()) {
+          throw std::runtime_error("cannot read " + dataset.image_path(cam, index));
+        }
+        buffer.resize((size_t)file.tellg());
+        file.seekg(0, std::ios::beg);
+        file.read(buffer.data(), buffer.size());
+        writer.add_frame(cam, std::get<0>(frame), Packed::kCompressed, 0, 0,
+                         buffer.data(), buffer.size());
+      }
+
+      // display progress
+      if (++counter % 100 == 0) {
+        std::cout << "\rProgress: "
+            << int(double(counter) / double(frames.size()) * 100) << "%  "
+            << std::flush;
+      }
+    }
+    writer.close();
+  } catch (const std::exception& e) {
+    LOG(ERROR)<< e.what();
+    if (created) {
+      boost::system::error_code error;
+      boost::filesystem::remove(args[1], error);
+    }
+    return -1;
+  }
+
+  std::cout << std::endl << std::flush;
+  return 0;
+}
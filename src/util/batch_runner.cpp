@@ -0,0 +1,215 @@
+#include "batch_runner.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cerrno>
+#include <algorithm>
+#include <set>
+
+#include <boost/filesystem.hpp>
+
+#ifndef _WIN32
+	#include <sys/types.h>
+	#include <sys/wait.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+namespace{
+
+    struct Job{
+        std::vector<std::string> args;
+        std::string dir;
+        int status;
+        double time;
+    };
+
+    const char* const kStatusFile = "status";
+
+    /// FNV-1a of the '\0' separated arguments
+    uint64_t hash_args(const std::vector<std::string>& args){
+        uint64_t hash = 14695981039346656037ULL;
+        for(const auto& arg : args){
+            for(size_t i = 0; i <= arg.size(); i++){
+                hash ^= (unsigned char)arg.c_str()[i];
+                hash *= 1099511628211ULL;
+            }
+        }
+        return hash;
+    }
+
+    ///
+    /// Status file contents: exit status and wall time [s] on the first line,
+    /// then one argument of the job per line. Returns false unless the file
+    /// exists and was written for exactly these arguments.
+    ///
+    bool read_status(const std::string& dir, const std::vector<std::string>& args, int& status, double& time){
+        std::ifstream file(dir + "/" + kStatusFile);
+        if(!(file >> status >> time))
+            return false;
+        std::string line;
+        std::getline(file, line);
+        std::vector<std::string> written;
+        while(std::getline(file, line))
+            written.push_back(line);
+        return written == args;
+    }
+
+    void write_status(const std::string& dir, const std::vector<std::string>& args, int status, double time){
+        std::ofstream file(dir + "/" + kStatusFile);
+        file << status << " " << time << "\n";
+        for(const auto& arg : args)
+            file << arg << "\n";
+    }
+
+    int run_process(const std::string& executable, const std::vector<std::string>& args,
+                    const std::string& log_file){
+#ifdef _WIN32
+        return -1;
+#else
+        // everything the child needs is prepared before the fork
+        std::vector<char*> argv;
+        argv.push_back(const_cast<char*>(executable.c_str()));
+        for(const auto& arg : args)
+            argv.push_back(const_cast<char*>(arg.c_str()));
+        argv.push_back(NULL);
+        const long max_fd = std::min(sysconf(_SC_OPEN_MAX), 65536L);
+
+        pid_t pid = fork();
+        if(pid < 0)
+            return -1;
+        if(pid == 0){
+            // nothing of the runner, e.g. the other jobs' files, is passed on
+            for(int fd = STDERR_FILENO + 1; fd < max_fd; fd++)
+                close(fd);
+            int fd = open(log_file.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if(fd >= 0){
+                dup2(fd, STDOUT_FILENO);
+                dup2(fd, STDERR_FILENO);
+                close(fd);
+            }
+            execv(argv[0], argv.data());
+            _exit(127);
+        }
+        int status;
+        while(waitpid(pid, &status, 0) < 0){
+            if(errno != EINTR)
+                return -1;
+        }
+        if(WIFEXITED(status))
+            return WEXITSTATUS(status);
+        return 128 + (WIFSIGNALED(status) ? WTERMSIG(status) : 0);
+#endif
+    }
+
+}
+
+namespace BatchRunner{
+
+    int run(const std::string& executable, const std::string& jobs_file,
+            const std::string& output_dir, size_t workers,
+            const std::vector<std::string>& extra_args){
+#ifdef _WIN32
+        std::cerr << "batch mode is not supported on this platform" << std::endl;
+        return -1;
+#endif
+        std::ifstream file(jobs_file);
+        if(!file.is_open()){
+            std::cerr << "cannot read " << jobs_file << std::endl;
+            return -1;
+        }
+        boost::system::error_code ec;
+        boost::filesystem::create_directories(output_dir, ec);
+
+        std::vector<Job> jobs;
+        std::set<std::string> dirs;
+        std::string line;
+        while(std::getline(file, line)){
+            std::stringstream stream(line);
+            Job job;
+            std::string arg;
+            while(stream >> arg)
+                job.args.push_back(arg);
+            if(job.args.size() < 2 || job.args[0][0] == '#')
+                continue;
+            // everything that affects the result, not the position in the file
+            job.args.insert(job.args.end(), extra_args.begin(), extra_args.end());
+            char hash[17];
+            snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)hash_args(job.args));
+            job.dir = output_dir + "/" + boost::filesystem::path(job.args[1]).filename().string() + "_" + hash;
+            if(!dirs.insert(job.dir).second){
+                std::cout << "Skipping repeated job " << line << std::endl;
+                continue;
+            }
+            job.status = -1;
+            job.time = 0.0;
+            jobs.push_back(job);
+        }
+
+        // each job runs the estimator's threads and its own prefetch pool
+        std::vector<std::string> run_args;
+        const bool prefetch_set = std::any_of(extra_args.begin(), extra_args.end(), [](const std::string& arg) {
+            return arg.compare(0, 19, "--prefetch-workers=") == 0;
+        });
+        if(!prefetch_set){
+            const size_t threads = std::max(1u, std::thread::hardware_concurrency());
+            const size_t concurrent = std::max<size_t>(1, std::min(workers, jobs.size()));
+            run_args.push_back("--prefetch-workers=" + std::to_string(std::max<size_t>(1, threads / concurrent / 2)));
+        }
+
+        std::mutex print_mutex;
+        std::atomic<size_t> next(0);
+        const auto worker = [&]() {
+            for(size_t i = next++; i < jobs.size(); i = next++){
+                Job& job = jobs[i];
+                if(read_status(job.dir, job.args, job.status, job.time) && job.status == 0){
+                    std::lock_guard<std::mutex> lock(print_mutex);
+                    std::cout << "Skipping finished job " << job.dir << std::endl;
+                    continue;
+                }
+                boost::system::error_code ec;
+                boost::filesystem::create_directories(job.dir, ec);
+
+                std::vector<std::string> args(job.args);
+                args.insert(args.end(), run_args.begin(), run_args.end());
+                args.push_back("--headless");
+                args.push_back("--trajectory=" + job.dir + "/trajectory.csv");
+
+                const auto start = std::chrono::steady_clock::now();
+                job.status = run_process(executable, args, job.dir + "/log.txt");
+                job.time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+                write_status(job.dir, job.args, job.status, job.time);
+
+                std::lock_guard<std::mutex> lock(print_mutex);
+                std::cout << (job.status == 0 ? "Finished " : "Failed ") << job.dir
+                          << " in " << job.time << "s" << std::endl;
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for(size_t i = 0; i < std::max<size_t>(workers, 1); i++)
+            threads.emplace_back(worker);
+        for(auto& t : threads)
+            t.join();
+
+        int failed = 0;
+        std::ofstream summary(output_dir + "/summary.csv");
+        summary << "#job, configuration, dataset, status, wall time [s]\n";
+        for(const Job& job : jobs){
+            summary << job.dir << "," << job.args[0] << "," << job.args[1] << ","
+                    << job.status << "," << job.time << "\n";
+            if(job.status != 0)
+                failed++;
+        }
+        return failed;
+    }
+
+}
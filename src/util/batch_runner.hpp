@@ -0,0 +1,29 @@
+#ifndef _BATCH_RUNNER_HPP_
+#define _BATCH_RUNNER_HPP_
+
+#include <string>
+#include <vector>
+
+namespace BatchRunner{
+
+    ///
+    /// Runs the jobs listed in jobs_file, one "configuration-yaml-file dataset-folder
+    /// [arguments...]" per line, concurrently on up to workers processes of executable.
+    /// Every job runs headless in its own process with its own directory in output_dir
+    /// holding the trajectory, the log and a status file. The directory is named after
+    /// the dataset and a hash of the job's arguments, and the status file repeats the
+    /// arguments, so a job which already finished successfully with the same arguments
+    /// is skipped and an interrupted batch resumes where it stopped, even if the jobs
+    /// file was edited in between. Unless extra_args set --prefetch-workers, the
+    /// hardware threads are split among the concurrent jobs for their prefetching.
+    /// A summary of all jobs is written to output_dir/summary.csv.
+    /// Returns the number of failed jobs, or -1 if the batch could not be started.
+    /// Only POSIX systems are supported, elsewhere it fails right away.
+    ///
+    int run(const std::string& executable, const std::string& jobs_file,
+            const std::string& output_dir, size_t workers,
+            const std::vector<std::string>& extra_args);
+
+}
+
+#endif
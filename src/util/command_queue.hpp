@@ -0,0 +1,54 @@
+#ifndef _COMMAND_QUEUE_HPP_
+#define _COMMAND_QUEUE_HPP_
+
+#include <functional>
+#include <mutex>
+#include <vector>
+
+///
+/// Commands pushed from any thread and run in order by one consumer, e.g.
+/// scene updates for the thread that owns the GL contexts. Producers only
+/// wait for the consumer to swap out the pending commands, never for the
+/// commands to run.
+///
+class CommandQueue
+{
+public:
+    typedef std::function<void()> Command;
+
+    CommandQueue() {}
+
+    CommandQueue(const CommandQueue&) = delete;
+    CommandQueue& operator=(const CommandQueue&) = delete;
+
+    void push(Command command){
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_.push_back(std::move(command));
+    }
+
+    /// Commands pushed and not yet taken by run()
+    size_t size() const{
+        std::lock_guard<std::mutex> lock(mutex_);
+        return pending_.size();
+    }
+
+    /// Consumer side, runs the commands pushed so far and returns their number
+    size_t run(){
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            running_.swap(pending_);
+        }
+        for(auto& command : running_)
+            command();
+        const size_t count = running_.size();
+        running_.clear();
+        return count;
+    }
+
+private:
+    mutable std::mutex mutex_;
+    std::vector<Command> pending_;
+    std::vector<Command> running_;  ///< only touched by the consumer
+};
+
+#endif
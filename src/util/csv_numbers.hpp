@@ -0,0 +1,115 @@
+#ifndef _CSV_NUMBERS_HPP_
+#define _CSV_NUMBERS_HPP_
+
+#include <cstdint>
+
+///
+/// Number parsing for the csv files of the ASL/EuRoC format, working on
+/// [p, end) ranges of a memory mapping without allocation or locale.
+/// Every function advances p past what it consumed.
+///
+namespace CsvNumbers{
+
+    const double kPow10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+    inline bool is_digit(char c){
+        return c >= '0' && c <= '9';
+    }
+
+    inline void skip_blanks(const char*& p, const char* end){
+        while(p < end && (*p == ' ' || *p == '\t'))
+            p++;
+    }
+
+    ///
+    /// Parses a (signed) integer, no allocation and no locale
+    ///
+    inline bool parse_int(const char*& p, const char* end, int64_t& value){
+        skip_blanks(p, end);
+        bool negative = false;
+        if(p < end && (*p == '-' || *p == '+'))
+            negative = (*p++ == '-');
+        if(p >= end || !is_digit(*p))
+            return false;
+        int64_t v = 0;
+        while(p < end && is_digit(*p))
+            v = v * 10 + (*p++ - '0');
+        value = negative ? -v : v;
+        return true;
+    }
+
+    ///
+    /// Parses a decimal number with optional fraction and exponent.
+    /// Up to 19 significant digits are kept, which is beyond what
+    /// any IMU in the datasets records.
+    ///
+    inline bool parse_double(const char*& p, const char* end, double& value){
+        skip_blanks(p, end);
+        bool negative = false;
+        if(p < end && (*p == '-' || *p == '+'))
+            negative = (*p++ == '-');
+        uint64_t mantissa = 0;
+        int digits = 0;
+        int exponent = 0;
+        bool any = false;
+        while(p < end && is_digit(*p)){
+            if(digits < 19){
+                mantissa = mantissa * 10 + (*p - '0');
+                if(mantissa != 0)
+                    digits++;
+            }else{
+                exponent++;
+            }
+            any = true;
+            p++;
+        }
+        if(p < end && *p == '.'){
+            p++;
+            while(p < end && is_digit(*p)){
+                if(digits < 19){
+                    mantissa = mantissa * 10 + (*p - '0');
+                    if(mantissa != 0)
+                        digits++;
+                    exponent--;
+                }
+                any = true;
+                p++;
+            }
+        }
+        if(!any)
+            return false;
+        if(p < end && (*p == 'e' || *p == 'E')){
+            p++;
+            int64_t e;
+            if(!parse_int(p, end, e))
+                return false;
+            exponent += (int)e;
+        }
+        double v = (double)mantissa;
+        while(exponent > 22){
+            v *= 1e22;
+            exponent -= 22;
+        }
+        while(exponent < -22){
+            v /= 1e22;
+            exponent += 22;
+        }
+        v = exponent >= 0 ? v * kPow10[exponent] : v / kPow10[-exponent];
+        value = negative ? -v : v;
+        return true;
+    }
+
+    inline bool expect_separator(const char*& p, const char* end){
+        skip_blanks(p, end);
+        if(p < end && *p == ','){
+            p++;
+            return true;
+        }
+        return false;
+    }
+
+}
+
+#endif
@@ -0,0 +1,260 @@
+#include "dataset.hpp"
+#include "packed_dataset.hpp"
+#include "mapped_file.hpp"
+#include "image_decoder.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+#include <boost/filesystem.hpp>
+
+#ifndef _WIN32
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+std::unique_ptr<Dataset> Dataset::open(const std::string& path, size_t num_cameras){
+    std::unique_ptr<Dataset> dataset;
+    if(boost::filesystem::is_regular_file(path)){
+        dataset.reset(new PackedDataset(path));
+    }else{
+        dataset.reset(new AslDataset(path, num_cameras));
+    }
+    if(dataset->num_cameras() < num_cameras){
+        throw std::runtime_error(path + " holds fewer cameras than configured");
+    }
+    return dataset;
+}
+
+void Dataset::set_reduction(size_t cam, int factor){
+    if(reductions_.size() <= cam)
+        reductions_.resize(cam + 1, 1);
+    reductions_[cam] = factor;
+}
+
+size_t Dataset::find_frame(size_t cam, int64_t timestamp) const{
+    size_t first = 0;
+    size_t count = num_frames(cam);
+    while(count > 0){
+        const size_t step = count / 2;
+        if(frame_timestamp(cam, first + step) < timestamp){
+            first += step + 1;
+            count -= step + 1;
+        }else{
+            count = step;
+        }
+    }
+    return first;
+}
+
+size_t Dataset::find_imu(int64_t timestamp) const{
+    const ImuSample* samples = imu_data();
+    return std::lower_bound(samples, samples + imu_size(), timestamp,
+                            [](const ImuSample& sample, int64_t t) { return sample.timestamp < t; })
+           - samples;
+}
+
+namespace{
+
+    const char kIndexMagic[8] = {'O','K','V','I','S','I','X','2'};
+
+    std::string image_folder(const std::string& path, size_t cam){
+        return path + "/cam" + std::to_string(cam) + "/data";
+    }
+
+    template<class T>
+    bool read_pod(const char*& p, const char* end, T* out, size_t count){
+        const size_t bytes = count * sizeof(T);
+        if((size_t)(end - p) < bytes)
+            return false;
+        memcpy(out, p, bytes);
+        p += bytes;
+        return true;
+    }
+
+    template<class T>
+    void write_pod(std::ofstream& file, const T* data, size_t count){
+        file.write((const char*)data, count * sizeof(T));
+    }
+
+    /// [ns], last_write_time only has seconds
+    int64_t modification_time(const std::string& path){
+#ifndef _WIN32
+        struct stat st;
+        if(stat(path.c_str(), &st) != 0)
+            throw std::runtime_error("cannot stat " + path);
+    #ifdef __APPLE__
+        return int64_t(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+    #else
+        return int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    #endif
+#else
+        return int64_t(boost::filesystem::last_write_time(path)) * 1000000000;
+#endif
+    }
+
+}
+
+const char* const AslDataset::kIndexFilename = ".okvis_index";
+
+AslDataset::AslDataset(const std::string& path, size_t num_cameras):
+path_(path),
+timestamps_(num_cameras),
+name_offsets_(num_cameras)
+{
+    if(!ImuReader::load(path_ + "/imu0/data.csv", imu_)){
+        throw std::runtime_error("no valid imu file found at " + path_ + "/imu0/data.csv");
+    }
+    if(imu_.empty()){
+        throw std::runtime_error("no imu messages present in " + path_ + "/imu0/data.csv");
+    }
+
+    std::vector<int64_t> mtimes(num_cameras);
+    for(size_t i = 0; i < num_cameras; ++i){
+        std::string folder = image_folder(path_, i);
+        if(!boost::filesystem::is_directory(folder)){
+            throw std::runtime_error("no images at " + folder);
+        }
+        mtimes[i] = modification_time(folder);
+    }
+
+    if(load_index(mtimes))
+        return;
+
+    names_.clear();
+    for(size_t i = 0; i < num_cameras; ++i){
+        scan_folder(i);
+    }
+    save_index(mtimes);
+}
+
+void AslDataset::scan_folder(size_t cam){
+    const std::string folder = image_folder(path_, cam);
+    // file names are <timestamp [ns]>.png
+    std::vector<std::pair<int64_t, std::string> > frames;
+    for(auto it = boost::filesystem::directory_iterator(folder);
+        it != boost::filesystem::directory_iterator(); it++){
+        if(it->status().type() == boost::filesystem::directory_file)  //we eliminate directories
+            continue;
+        std::string name = it->path().filename().string();
+        frames.push_back(std::make_pair((int64_t)strtoll(name.c_str(), NULL, 10), name));
+    }
+    if(frames.empty()){
+        throw std::runtime_error("no images at " + folder);
+    }
+    // the filenames are not going to be sorted. So do this here
+    std::sort(frames.begin(), frames.end());
+    timestamps_[cam].reserve(frames.size());
+    name_offsets_[cam].reserve(frames.size());
+    for(const auto& frame : frames){
+        timestamps_[cam].push_back(frame.first);
+        name_offsets_[cam].push_back((uint32_t)names_.size());
+        names_.insert(names_.end(), frame.second.begin(), frame.second.end());
+        names_.push_back('\0');
+    }
+}
+
+///
+/// Index file layout:
+/// magic, uint32 number of cameras, then per camera the folder mtime [ns],
+/// the frame count n, n timestamps and n name offsets, and finally the
+/// size of the name arena followed by the arena itself.
+///
+bool AslDataset::load_index(const std::vector<int64_t>& mtimes){
+    MappedFile file;
+    if(!file.open(path_ + "/" + kIndexFilename))
+        return false;
+    const char* p = file.data();
+    const char* end = p + file.size();
+
+    char magic[sizeof(kIndexMagic)];
+    uint32_t num_cameras;
+    if(!read_pod(p, end, magic, sizeof(magic)) || memcmp(magic, kIndexMagic, sizeof(magic)) != 0 ||
+       !read_pod(p, end, &num_cameras, 1) || num_cameras < timestamps_.size())
+        return false;
+
+    std::vector<std::vector<int64_t> > timestamps(num_cameras);
+    std::vector<std::vector<uint32_t> > name_offsets(num_cameras);
+    for(size_t i = 0; i < num_cameras; ++i){
+        int64_t mtime;
+        uint64_t count;
+        if(!read_pod(p, end, &mtime, 1) || !read_pod(p, end, &count, 1))
+            return false;
+        // only the requested cameras have to be up to date
+        if(i < mtimes.size() && mtime != mtimes[i])
+            return false;
+        if((size_t)(end - p) < count * (sizeof(int64_t) + sizeof(uint32_t)))
+            return false;
+        timestamps[i].resize(count);
+        name_offsets[i].resize(count);
+        read_pod(p, end, timestamps[i].data(), count);
+        read_pod(p, end, name_offsets[i].data(), count);
+    }
+    uint64_t arena_size;
+    if(!read_pod(p, end, &arena_size, 1) || (uint64_t)(end - p) != arena_size)
+        return false;
+    std::vector<char> names(p, end);
+
+    for(size_t i = 0; i < timestamps_.size(); ++i){
+        for(const uint32_t offset : name_offsets[i]){
+            if(offset >= arena_size)
+                return false;
+        }
+        timestamps_[i].swap(timestamps[i]);
+        name_offsets_[i].swap(name_offsets[i]);
+    }
+    names_.swap(names);
+    return true;
+}
+
+void AslDataset::save_index(const std::vector<int64_t>& mtimes) const{
+    // the dataset may well be read only, the index is only a cache.
+    // Other processes may have the index mapped, so it is written under a
+    // unique name and renamed over the old one once it is complete.
+    const boost::filesystem::path filename = boost::filesystem::path(path_) / kIndexFilename;
+    const boost::filesystem::path temporary = boost::filesystem::path(path_) /
+        boost::filesystem::unique_path(std::string(kIndexFilename) + ".%%%%-%%%%-%%%%");
+    std::ofstream file(temporary.string(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if(!file.is_open())
+        return;
+    const uint32_t num_cameras = (uint32_t)timestamps_.size();
+    write_pod(file, kIndexMagic, sizeof(kIndexMagic));
+    write_pod(file, &num_cameras, 1);
+    for(size_t i = 0; i < num_cameras; ++i){
+        const uint64_t count = timestamps_[i].size();
+        write_pod(file, &mtimes[i], 1);
+        write_pod(file, &count, 1);
+        write_pod(file, timestamps_[i].data(), count);
+        write_pod(file, name_offsets_[i].data(), count);
+    }
+    const uint64_t arena_size = names_.size();
+    write_pod(file, &arena_size, 1);
+    write_pod(file, names_.data(), names_.size());
+    file.close();
+
+    bool ok = !file.fail();
+#ifndef _WIN32
+    // the data has to be on disk before the rename makes it visible
+    const int fd = ::open(temporary.c_str(), O_RDONLY);
+    ok = ok && fd >= 0 && fsync(fd) == 0;
+    if(fd >= 0)
+        ::close(fd);
+#endif
+    boost::system::error_code error;
+    if(ok)
+        boost::filesystem::rename(temporary, filename, error);
+    if(!ok || error)
+        boost::filesystem::remove(temporary, error);
+}
+
+std::string AslDataset::image_path(size_t cam, size_t frame) const{
+    return image_folder(path_, cam) + "/" + &names_[name_offsets_[cam][frame]];
+}
+
+cv::Mat AslDataset::load_image(size_t cam, size_t frame) const{
+    return ImageDecoder::decode_file(image_path(cam, frame), reduction(cam));
+}
@@ -0,0 +1,108 @@
+#ifndef _DATASET_HPP_
+#define _DATASET_HPP_
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+#include <opencv2/core/core.hpp>
+
+#include "imu_reader.hpp"
+
+///
+/// Read access to a recorded sequence: per camera a time sorted list of frames
+/// and one time sorted array of IMU samples. Timestamps are in [ns].
+/// load_image may be called concurrently from several threads.
+///
+class Dataset
+{
+public:
+    virtual ~Dataset(){}
+
+    virtual size_t num_cameras() const = 0;
+
+    virtual size_t num_frames(size_t cam) const = 0;
+
+    virtual int64_t frame_timestamp(size_t cam, size_t frame) const = 0;
+
+    /// Returns the frame as 8 bit grayscale image
+    virtual cv::Mat load_image(size_t cam, size_t frame) const = 0;
+
+    ///
+    /// Frames of camera cam are from now on decoded downscaled by factor
+    /// (1, 2, 4 or 8) to floor(cols / factor) x floor(rows / factor)
+    ///
+    void set_reduction(size_t cam, int factor);
+
+    virtual const ImuSample* imu_data() const = 0;
+
+    virtual size_t imu_size() const = 0;
+
+    /// Index of the first frame of camera cam with a timestamp >= timestamp (binary search)
+    size_t find_frame(size_t cam, int64_t timestamp) const;
+
+    /// Index of the first IMU sample with a timestamp >= timestamp (binary search)
+    size_t find_imu(int64_t timestamp) const;
+
+    ///
+    /// Opens a packed dataset file or an ASL/EuRoC dataset folder,
+    /// depending on what path points to.
+    /// Throws std::runtime_error if the dataset cannot be read.
+    ///
+    static std::unique_ptr<Dataset> open(const std::string& path, size_t num_cameras);
+
+protected:
+    int reduction(size_t cam) const { return cam < reductions_.size() ? reductions_[cam] : 1; }
+
+private:
+    std::vector<int> reductions_;
+};
+
+///
+/// The ASL/EuRoC folder layout: camN/data/<timestamp>.png and imu0/data.csv
+///
+/// Listing large image folders is slow, so the sorted frame list is kept in a
+/// compact index file (kIndexFilename, next to the camN folders). It is reused
+/// as long as the modification times of the image folders did not change, to
+/// the nanosecond where the file system keeps them. The index is replaced
+/// atomically, so other processes mapping it never see a partial file.
+///
+class AslDataset : public Dataset
+{
+public:
+    AslDataset(const std::string& path, size_t num_cameras);
+
+    size_t num_cameras() const { return timestamps_.size(); }
+
+    size_t num_frames(size_t cam) const { return timestamps_[cam].size(); }
+
+    int64_t frame_timestamp(size_t cam, size_t frame) const { return timestamps_[cam][frame]; }
+
+    cv::Mat load_image(size_t cam, size_t frame) const;
+
+    const ImuSample* imu_data() const { return imu_.data(); }
+
+    size_t imu_size() const { return imu_.size(); }
+
+    /// Full path of an image file
+    std::string image_path(size_t cam, size_t frame) const;
+
+    static const char* const kIndexFilename;
+
+private:
+    void scan_folder(size_t cam);
+
+    bool load_index(const std::vector<int64_t>& mtimes);
+
+    void save_index(const std::vector<int64_t>& mtimes) const;
+
+    std::string path_;
+    std::vector<std::vector<int64_t> > timestamps_;
+    /// per frame offset of its '\0' terminated file name in names_
+    std::vector<std::vector<uint32_t> > name_offsets_;
+    std::vector<char> names_;
+    std::vector<ImuSample> imu_;
+};
+
+#endif
@@ -0,0 +1,292 @@
+#include "frame_cache.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <sstream>
+#include <iomanip>
+
+#include <boost/filesystem.hpp>
+
+#ifndef _WIN32
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+namespace{
+
+    const char kCacheMagic[8] = {'O','K','V','I','S','F','C','2'};
+    const size_t kPageSize = 4096;
+    const char* const kCacheExtension = ".frames";
+
+    struct FileHeader{
+        char magic[8];
+        int32_t rows;
+        int32_t cols;
+        uint64_t slot_size;
+        uint64_t num_frames;
+        int32_t type;        ///< of the pixels, CV_8UC1
+        int32_t padding;
+        uint64_t reserved[3];
+    };
+
+    /// One per frame after the file header
+    struct SlotEntry{
+        int64_t timestamp;
+        uint64_t valid;   ///< kValid once the pixels are written
+    };
+
+    const uint64_t kValid = 1;
+
+    inline size_t page_aligned(size_t size){
+        return (size + kPageSize - 1) / kPageSize * kPageSize;
+    }
+
+    /// FNV-1a, stable across runs and platforms unlike std::hash
+    uint64_t hash(const std::string& s){
+        uint64_t h = 14695981039346656037ull;
+        for(const char c : s){
+            h ^= (unsigned char)c;
+            h *= 1099511628211ull;
+        }
+        return h;
+    }
+
+    /// Bytes actually allocated on disk, cache files are sparse
+    uint64_t disk_usage(const std::string& filename){
+#ifdef _WIN32
+        return boost::filesystem::file_size(filename);
+#else
+        struct stat st;
+        if(stat(filename.c_str(), &st) != 0)
+            return 0;
+        return (uint64_t)st.st_blocks * 512;
+#endif
+    }
+
+}
+
+CachedDataset::CachedDataset(std::unique_ptr<Dataset> dataset, const std::string& dataset_path,
+                             const std::string& cache_dir, uint64_t max_bytes, const std::string& key):
+dataset_(std::move(dataset)),
+cache_dir_(cache_dir),
+max_bytes_(max_bytes),
+used_bytes_(0),
+full_(false)
+{
+    boost::system::error_code ec;
+    boost::filesystem::create_directories(cache_dir_, ec);
+    const std::string absolute = boost::filesystem::absolute(dataset_path).string();
+    std::stringstream prefix;
+    prefix << cache_dir_ << "/" << std::hex << std::setw(16) << std::setfill('0') << hash(absolute + "|" + key);
+
+    for(size_t cam = 0; cam < dataset_->num_cameras(); ++cam){
+        cameras_.emplace_back(new CameraCache);
+        CameraCache& cache = *cameras_.back();
+        cache.filename = prefix.str() + "_cam" + std::to_string(cam) + kCacheExtension;
+        if(boost::filesystem::exists(cache.filename)){
+            if(open_file(cache, cam, false)){
+                // mark as recently used
+                boost::filesystem::last_write_time(cache.filename, std::time(NULL), ec);
+            }else{
+                boost::filesystem::remove(cache.filename, ec);
+            }
+        }
+    }
+    evict(max_bytes_);
+}
+
+CachedDataset::~CachedDataset(){
+#ifndef _WIN32
+    for(const auto& cache : cameras_){
+        if(cache->map != NULL)
+            munmap(cache->map, cache->map_size);
+        if(cache->fd >= 0)
+            ::close(cache->fd);
+    }
+#endif
+}
+
+void CachedDataset::evict(uint64_t target) const{
+    std::vector<std::pair<std::time_t, std::string> > files;
+    uint64_t total = 0;
+    boost::system::error_code ec;
+    for(auto it = boost::filesystem::directory_iterator(cache_dir_, ec);
+        it != boost::filesystem::directory_iterator(); it.increment(ec)){
+        if(it->path().extension() != kCacheExtension)
+            continue;
+        const std::string filename = it->path().string();
+        total += disk_usage(filename);
+        bool ours = false;
+        for(const auto& cache : cameras_){
+            ours = ours || cache->filename == filename;
+        }
+        if(!ours)
+            files.push_back(std::make_pair(boost::filesystem::last_write_time(it->path(), ec), filename));
+    }
+    // least recently used first
+    std::sort(files.begin(), files.end());
+    for(const auto& file : files){
+        if(total <= target)
+            break;
+        const uint64_t size = disk_usage(file.second);
+        if(boost::filesystem::remove(file.second, ec))
+            total -= std::min(total, size);
+    }
+    used_bytes_ = total;
+}
+
+bool CachedDataset::make_room(uint64_t bytes) const{
+    std::lock_guard<std::mutex> lock(evict_mutex_);
+    if(full_ || bytes > max_bytes_)
+        return false;
+    // another thread may have made room meanwhile
+    if(used_bytes_.fetch_add(bytes) + bytes <= max_bytes_)
+        return true;
+    used_bytes_ -= bytes;
+    evict(max_bytes_ - bytes);
+    if(used_bytes_ + bytes > max_bytes_){
+        full_ = true;
+        return false;
+    }
+    used_bytes_ += bytes;
+    return true;
+}
+
+#ifndef _WIN32
+
+bool CachedDataset::open_file(CameraCache& cache, size_t cam, bool create) const{
+    const uint64_t num_frames = dataset_->num_frames(cam);
+    FileHeader header;
+    // other processes may have the file mapped, so it is never truncated:
+    // a new file is set up under a unique name and then renamed into place
+    std::string temporary;
+    if(create){
+        std::vector<char> name(cache.filename.begin(), cache.filename.end());
+        const char suffix[] = ".XXXXXX";
+        name.insert(name.end(), suffix, suffix + sizeof(suffix));
+        cache.fd = mkstemp(name.data());
+        if(cache.fd >= 0){
+            temporary = name.data();
+            fchmod(cache.fd, 0644);
+        }
+    }else{
+        cache.fd = ::open(cache.filename.c_str(), O_RDWR);
+    }
+    if(cache.fd < 0)
+        return false;
+    if(create){
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, kCacheMagic, sizeof(header.magic));
+        header.rows = cache.rows;
+        header.cols = cache.cols;
+        header.slot_size = page_aligned((size_t)cache.rows * cache.cols);
+        header.num_frames = num_frames;
+        header.type = CV_8UC1;
+    }else if(pread(cache.fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+             memcmp(header.magic, kCacheMagic, sizeof(header.magic)) != 0 ||
+             header.num_frames != num_frames || header.type != CV_8UC1 ||
+             header.rows <= 0 || header.cols <= 0 ||
+             header.slot_size != page_aligned((size_t)header.rows * header.cols)){
+        // stale or foreign
+        ::close(cache.fd);
+        cache.fd = -1;
+        return false;
+    }
+    cache.rows = header.rows;
+    cache.cols = header.cols;
+    cache.slot_size = header.slot_size;
+    cache.data_offset = page_aligned(sizeof(header) + num_frames * sizeof(SlotEntry));
+    cache.map_size = cache.data_offset + num_frames * cache.slot_size;
+
+    // the file is sparse, only the written slots take up space
+    struct stat st;
+    if((create && (pwrite(cache.fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+                   ftruncate(cache.fd, cache.map_size) != 0 ||
+                   rename(temporary.c_str(), cache.filename.c_str()) != 0)) ||
+       fstat(cache.fd, &st) != 0 || (size_t)st.st_size != cache.map_size){
+        ::close(cache.fd);
+        cache.fd = -1;
+        if(!temporary.empty())
+            unlink(temporary.c_str());
+        return false;
+    }
+    void* map = mmap(NULL, cache.map_size, PROT_READ, MAP_SHARED, cache.fd, 0);
+    if(map == MAP_FAILED){
+        ::close(cache.fd);
+        cache.fd = -1;
+        return false;
+    }
+    cache.map = (char*)map;
+    return true;
+}
+
+void CachedDataset::store(CameraCache& cache, size_t cam, size_t frame, const cv::Mat& image) const{
+    if(image.type() != CV_8UC1)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(cache.mutex);
+        if(cache.map == NULL){
+            // created with the size of the first frame, or given up on
+            if(cache.fd != -1)
+                return;
+            cache.rows = image.rows;
+            cache.cols = image.cols;
+            if(!open_file(cache, cam, true)){
+                cache.fd = -2;
+                return;
+            }
+        }
+    }
+    if(image.rows != cache.rows || image.cols != cache.cols)
+        return;
+    if(used_bytes_.fetch_add(cache.slot_size) + cache.slot_size > max_bytes_){
+        used_bytes_ -= cache.slot_size;
+        if(!make_room(cache.slot_size))
+            return;
+    }
+
+    const off_t offset = cache.data_offset + frame * cache.slot_size;
+    const size_t row_size = (size_t)image.cols;
+    for(int r = 0; r < image.rows; ++r){
+        if(pwrite(cache.fd, image.ptr(r), row_size, offset + r * row_size) != (ssize_t)row_size)
+            return;
+    }
+    // the entry marks the slot valid, so it goes last
+    SlotEntry entry;
+    entry.timestamp = dataset_->frame_timestamp(cam, frame);
+    entry.valid = kValid;
+    pwrite(cache.fd, &entry, sizeof(entry), sizeof(FileHeader) + frame * sizeof(SlotEntry));
+}
+
+#else
+
+bool CachedDataset::open_file(CameraCache&, size_t, bool) const{
+    return false;
+}
+
+void CachedDataset::store(CameraCache&, size_t, size_t, const cv::Mat&) const{
+}
+
+#endif
+
+cv::Mat CachedDataset::load_image(size_t cam, size_t frame) const{
+    CameraCache& cache = *cameras_[cam];
+    const char* map;
+    {
+        std::lock_guard<std::mutex> lock(cache.mutex);
+        map = cache.map;
+    }
+    const int64_t timestamp = dataset_->frame_timestamp(cam, frame);
+    const SlotEntry* entry = map != NULL ? (const SlotEntry*)(map + sizeof(FileHeader)) + frame : NULL;
+    if(entry != NULL && entry->valid == kValid && entry->timestamp == timestamp){
+        return cv::Mat(cache.rows, cache.cols, CV_8UC1,
+                       (void*)(map + cache.data_offset + frame * cache.slot_size));
+    }
+    cv::Mat image = dataset_->load_image(cam, frame);
+    if(!image.empty())
+        store(cache, cam, frame, image);
+    return image;
+}
@@ -0,0 +1,84 @@
+#ifndef _FRAME_CACHE_HPP_
+#define _FRAME_CACHE_HPP_
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+
+#include "dataset.hpp"
+
+///
+/// Dataset decorator which keeps decoded frames in an on-disk cache, so
+/// repeated runs over the same sequence skip decoding altogether.
+///
+/// Every camera of a dataset gets one cache file in the cache directory, keyed
+/// by the dataset path. The file holds a table of frame timestamps and valid
+/// flags followed by one page aligned slot of raw pixels per frame. Cached
+/// frames are returned as cv::Mat headers into a shared memory mapping of that
+/// file, so the cache has to outlive every image it handed out. Several
+/// processes may share a cache file: it is never truncated once in place, new
+/// files are completed under a temporary name and renamed into place.
+/// Whenever the directory would grow beyond max_bytes, at the start or while
+/// frames are stored, the files of other datasets are evicted least recently
+/// used first. Only POSIX systems are supported, elsewhere frames are passed
+/// through uncached.
+///
+class CachedDataset : public Dataset
+{
+public:
+    /// key distinguishes differently decoded variants of the same dataset
+    CachedDataset(std::unique_ptr<Dataset> dataset, const std::string& dataset_path,
+                  const std::string& cache_dir, uint64_t max_bytes,
+                  const std::string& key = std::string());
+
+    ~CachedDataset();
+
+    size_t num_cameras() const { return dataset_->num_cameras(); }
+
+    size_t num_frames(size_t cam) const { return dataset_->num_frames(cam); }
+
+    int64_t frame_timestamp(size_t cam, size_t frame) const { return dataset_->frame_timestamp(cam, frame); }
+
+    cv::Mat load_image(size_t cam, size_t frame) const;
+
+    const ImuSample* imu_data() const { return dataset_->imu_data(); }
+
+    size_t imu_size() const { return dataset_->imu_size(); }
+
+private:
+    struct CameraCache{
+        std::string filename;
+        int fd;
+        char* map;
+        size_t map_size;
+        int rows;
+        int cols;
+        size_t slot_size;
+        size_t data_offset;
+        std::mutex mutex;
+        CameraCache() : fd(-1), map(NULL), map_size(0), rows(0), cols(0), slot_size(0), data_offset(0) {}
+    };
+
+    bool open_file(CameraCache& cache, size_t cam, bool create) const;
+
+    void store(CameraCache& cache, size_t cam, size_t frame, const cv::Mat& image) const;
+
+    /// Removes files of other datasets, least recently used first, until the directory holds at most target bytes
+    void evict(uint64_t target) const;
+
+    /// Evicts for bytes more, returns false if there is no room left
+    bool make_room(uint64_t bytes) const;
+
+    std::unique_ptr<Dataset> dataset_;
+    std::string cache_dir_;
+    uint64_t max_bytes_;
+    mutable std::vector<std::unique_ptr<CameraCache> > cameras_;
+    mutable std::atomic<uint64_t> used_bytes_;
+    mutable std::mutex evict_mutex_;
+    mutable bool full_;   ///< nothing left to evict
+};
+
+#endif
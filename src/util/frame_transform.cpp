@@ -0,0 +1,127 @@
+#include "frame_transform.hpp"
+#include "image_decoder.hpp"
+
+#include <sstream>
+#include <cstdio>
+
+namespace{
+
+    std::vector<std::string> split(const std::string& s, char separator){
+        std::vector<std::string> parts;
+        std::stringstream stream(s);
+        std::string part;
+        while(std::getline(stream, part, separator))
+            parts.push_back(part);
+        return parts;
+    }
+
+    /// One entry per camera, or a single one for all of them
+    bool per_camera(const std::string& s, size_t num_cameras, std::vector<std::string>& entries){
+        entries = split(s, ',');
+        if(entries.size() == 1)
+            entries.assign(num_cameras, entries[0]);
+        return entries.size() == num_cameras;
+    }
+
+    bool is_power_of_two(int factor, int max){
+        return factor == 1 || factor == 2 || factor == 4 || (factor == 8 && max >= 8);
+    }
+
+}
+
+bool FrameTransform::fits(int width, int height) const{
+    if(roi.area() != 0 && (roi.x + roi.width > width || roi.y + roi.height > height))
+        return false;
+    const cv::Size size = output_size(width, height);
+    return size.width > 0 && size.height > 0;
+}
+
+cv::Rect FrameTransform::reduced_roi(int width, int height) const{
+    const cv::Rect full(0, 0, width / reduction, height / reduction);
+    if(roi.area() == 0)
+        return full;
+    return cv::Rect(roi.x / reduction, roi.y / reduction,
+                    roi.width / reduction, roi.height / reduction) & full;
+}
+
+cv::Size FrameTransform::output_size(int width, int height) const{
+    const cv::Rect r = reduced_roi(width, height);
+    return cv::Size(r.width / binning, r.height / binning);
+}
+
+void FrameTransform::transform_intrinsics(int width, int height,
+                                          double& fu, double& fv, double& cu, double& cv) const{
+    const cv::Rect r = reduced_roi(width, height);
+    fu /= reduction * binning;
+    fv /= reduction * binning;
+    cu = (((cu + 0.5) / reduction - 0.5 - r.x) + 0.5) / binning - 0.5;
+    cv = (((cv + 0.5) / reduction - 0.5 - r.y) + 0.5) / binning - 0.5;
+}
+
+std::string FrameTransform::key() const{
+    std::stringstream key;
+    key << "r" << reduction << "_b" << binning << "_" << roi.x << "_" << roi.y
+        << "_" << roi.width << "_" << roi.height;
+    return key.str();
+}
+
+bool FrameTransform::parse(size_t num_cameras, const std::string& reduction, const std::string& roi,
+                           const std::string& binning, std::vector<FrameTransform>& transforms){
+    transforms.assign(num_cameras, FrameTransform());
+    std::vector<std::string> entries;
+    if(!reduction.empty()){
+        if(!per_camera(reduction, num_cameras, entries))
+            return false;
+        for(size_t i = 0; i < num_cameras; ++i){
+            transforms[i].reduction = atoi(entries[i].c_str());
+            if(!is_power_of_two(transforms[i].reduction, 8))
+                return false;
+        }
+    }
+    if(!binning.empty()){
+        if(!per_camera(binning, num_cameras, entries))
+            return false;
+        for(size_t i = 0; i < num_cameras; ++i){
+            transforms[i].binning = atoi(entries[i].c_str());
+            if(!is_power_of_two(transforms[i].binning, 4))
+                return false;
+        }
+    }
+    if(!roi.empty()){
+        if(!per_camera(roi, num_cameras, entries))
+            return false;
+        for(size_t i = 0; i < num_cameras; ++i){
+            if(entries[i] == "-")
+                continue;
+            cv::Rect& r = transforms[i].roi;
+            if(sscanf(entries[i].c_str(), "%d:%d:%d:%d", &r.x, &r.y, &r.width, &r.height) != 4 ||
+               r.x < 0 || r.y < 0 || r.width <= 0 || r.height <= 0)
+                return false;
+        }
+    }
+    return true;
+}
+
+TransformedDataset::TransformedDataset(std::unique_ptr<Dataset> dataset,
+                                       const std::vector<FrameTransform>& transforms,
+                                       const std::vector<cv::Size>& full_sizes):
+dataset_(std::move(dataset)),
+transforms_(transforms)
+{
+    for(size_t cam = 0; cam < transforms_.size(); ++cam){
+        dataset_->set_reduction(cam, transforms_[cam].reduction);
+        rois_.push_back(transforms_[cam].reduced_roi(full_sizes[cam].width, full_sizes[cam].height));
+    }
+}
+
+cv::Mat TransformedDataset::load_image(size_t cam, size_t frame) const{
+    cv::Mat image = dataset_->load_image(cam, frame);
+    if(image.empty() || cam >= transforms_.size())
+        return image;
+    const cv::Rect roi = rois_[cam] & cv::Rect(0, 0, image.cols, image.rows);
+    if(roi.width != image.cols || roi.height != image.rows)
+        image = image(roi);
+    for(int b = transforms_[cam].binning; b > 1; b /= 2)
+        image = ImageDecoder::bin2x2(image);
+    return image;
+}
@@ -0,0 +1,85 @@
+#ifndef _FRAME_TRANSFORM_HPP_
+#define _FRAME_TRANSFORM_HPP_
+
+#include <string>
+#include <vector>
+#include <memory>
+
+#include <opencv2/core/core.hpp>
+
+#include "dataset.hpp"
+
+///
+/// Per camera ingestion stage which trades resolution for throughput:
+/// decode at reduced resolution, crop to a fixed region of interest and
+/// bin 2x2 pixel blocks, in this order.
+///
+struct FrameTransform{
+    int reduction;   ///< decode time downscaling, 1, 2, 4 or 8
+    cv::Rect roi;    ///< crop in full resolution pixels, empty for the whole image
+    int binning;     ///< 1, 2 or 4, applied after cropping
+
+    FrameTransform() : reduction(1), roi(), binning(1) {}
+
+    bool identity() const{
+        return reduction == 1 && roi.area() == 0 && binning == 1;
+    }
+
+    /// Whether the roi lies within a full resolution frame of width x height and the output is not empty
+    bool fits(int width, int height) const;
+
+    /// Region of interest in pixels of the reduced image
+    cv::Rect reduced_roi(int width, int height) const;
+
+    /// Size of the output for a full resolution frame of width x height
+    cv::Size output_size(int width, int height) const;
+
+    ///
+    /// Maps pinhole intrinsics of the full resolution camera to the output
+    /// frames (pixel centers at integer coordinates). Distortion parameters
+    /// act on normalized coordinates and stay as they are.
+    ///
+    void transform_intrinsics(int width, int height,
+                              double& fu, double& fv, double& cu, double& cv) const;
+
+    /// Identifies the transform, e.g. to key cached frames
+    std::string key() const;
+
+    ///
+    /// Parses the per camera settings, each a comma separated list with one
+    /// entry per camera or a single entry for all: reduction "2,1", binning "2"
+    /// and roi "x:y:w:h,x:y:w:h" ("-" for none). Returns false on invalid input.
+    ///
+    static bool parse(size_t num_cameras, const std::string& reduction, const std::string& roi,
+                      const std::string& binning, std::vector<FrameTransform>& transforms);
+};
+
+///
+/// Dataset decorator applying a FrameTransform to the frames of every camera
+///
+class TransformedDataset : public Dataset
+{
+public:
+    /// full_sizes are the full resolution frame sizes of the cameras
+    TransformedDataset(std::unique_ptr<Dataset> dataset, const std::vector<FrameTransform>& transforms,
+                       const std::vector<cv::Size>& full_sizes);
+
+    size_t num_cameras() const { return dataset_->num_cameras(); }
+
+    size_t num_frames(size_t cam) const { return dataset_->num_frames(cam); }
+
+    int64_t frame_timestamp(size_t cam, size_t frame) const { return dataset_->frame_timestamp(cam, frame); }
+
+    cv::Mat load_image(size_t cam, size_t frame) const;
+
+    const ImuSample* imu_data() const { return dataset_->imu_data(); }
+
+    size_t imu_size() const { return dataset_->imu_size(); }
+
+private:
+    std::unique_ptr<Dataset> dataset_;
+    std::vector<FrameTransform> transforms_;
+    std::vector<cv::Rect> rois_;
+};
+
+#endif
@@ -1,8 +1,99 @@
 #include "glfwManager.h"
 #include <iostream>
+#include <cmath>
+#include <cstring>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+#include "../third_party/stb_easy_font.h"
+#pragma GCC diagnostic pop
 
 namespace MyGUI{
 
+namespace{
+
+// sized internal format keeping the channels of the image
+GLenum texture_format(GLenum format, GLenum type){
+	const bool wide = (type == GL_UNSIGNED_SHORT || type == GL_SHORT);
+	switch(format){
+	case GL_LUMINANCE:
+	case GL_RED:
+		return wide ? GL_LUMINANCE16 : GL_LUMINANCE8;
+	case GL_RGB:
+	case GL_BGR:
+		return wide ? GL_RGB16 : GL_RGB8;
+	default:
+		return wide ? GL_RGBA16 : GL_RGBA8;
+	}
+}
+
+// false if all corners of the box are beyond the same clip plane
+bool box_visible(const Eigen::Vector3f& min, const Eigen::Vector3f& max, const Eigen::Matrix4f& mvp){
+	int outside[6] = {0, 0, 0, 0, 0, 0};
+	for(int i = 0; i < 8; ++i){
+		const Eigen::Vector4f corner(i & 1 ? max.x() : min.x(),
+		                             i & 2 ? max.y() : min.y(),
+		                             i & 4 ? max.z() : min.z(), 1.0f);
+		const Eigen::Vector4f c = mvp * corner;
+		outside[0] += c.x() < -c.w();
+		outside[1] += c.x() > c.w();
+		outside[2] += c.y() < -c.w();
+		outside[3] += c.y() > c.w();
+		outside[4] += c.z() < -c.w();
+		outside[5] += c.z() > c.w();
+	}
+	for(int i = 0; i < 6; ++i){
+		if(outside[i] == 8)
+			return false;
+	}
+	return true;
+}
+
+// same as gluPerspective
+Eigen::Matrix4d perspective(double fovy, double aspect, double z_near, double z_far){
+	const double f = 1.0 / std::tan(fovy * M_PI / 360.0);
+	Eigen::Matrix4d m = Eigen::Matrix4d::Zero();
+	m(0,0) = f / aspect;
+	m(1,1) = f;
+	m(2,2) = (z_far + z_near) / (z_near - z_far);
+	m(2,3) = 2.0 * z_far * z_near / (z_near - z_far);
+	m(3,2) = -1.0;
+	return m;
+}
+
+// same as glOrtho, extent across the smaller side of the viewport
+Eigen::Matrix4d orthographic(double extent, int width, int height, double z_near, double z_far){
+	const double half = 0.5 * extent / std::min(width, height);
+	const double right = half * width;
+	const double top = half * height;
+	Eigen::Matrix4d m = Eigen::Matrix4d::Identity();
+	m(0,0) = 1.0 / right;
+	m(1,1) = 1.0 / top;
+	m(2,2) = -2.0 / (z_far - z_near);
+	m(2,3) = -(z_far + z_near) / (z_far - z_near);
+	return m;
+}
+
+// same as gluLookAt
+Eigen::Matrix4d look_at(const Eigen::Vector3d& eye, const Eigen::Vector3d& center, const Eigen::Vector3d& up){
+	const Eigen::Vector3d f = (center - eye).normalized();
+	const Eigen::Vector3d s = f.cross(up).normalized();
+	const Eigen::Vector3d u = s.cross(f);
+	Eigen::Matrix4d m = Eigen::Matrix4d::Identity();
+	m.block<1,3>(0,0) = s.transpose();
+	m.block<1,3>(1,0) = u.transpose();
+	m.block<1,3>(2,0) = -f.transpose();
+	m(0,3) = -s.dot(eye);
+	m(1,3) = -u.dot(eye);
+	m(2,3) = f.dot(eye);
+	return m;
+}
+
+}
+
 std::map<std::string,Window*> Manager::windows;
 
 
@@ -31,12 +122,32 @@ void Manager::update(){
 
 
 
-Window::Window(std::string name, int resX, int resY):
+void Manager::wait_events(double timeout){
+#if GLFW_VERSION_MAJOR > 3 || (GLFW_VERSION_MAJOR == 3 && GLFW_VERSION_MINOR >= 2)
+	glfwWaitEventsTimeout(timeout);
+#else
+	// no timed wait before GLFW 3.2
+	std::this_thread::sleep_for(std::chrono::duration<double>(timeout));
+	glfwPollEvents();
+#endif
+}
+
+Window::Window(std::string name, int resX, int resY, bool visible):
 name_(name){
 	glfwWindowHint(GLFW_SAMPLES, 4); // 4x antialiasing
-	win_ptr= glfwCreateWindow(resX, resY, name.c_str(), NULL, NULL);
+	glfwWindowHint(GLFW_VISIBLE, visible ? GL_TRUE : GL_FALSE);
+	win_ptr= glfwCreateWindow(resX, resY, name.c_str(), NULL, shared_context());
+	glfwWindowHint(GLFW_VISIBLE, GL_TRUE);
 	if(win_ptr!=NULL){
 		glfwMakeContextCurrent(win_ptr);
+#ifndef _WIN32
+		// entry points of buffer objects, once a context exists
+		static bool glew_initialized = false;
+		if(!glew_initialized){
+			glewExperimental = GL_TRUE;
+			glew_initialized = (glewInit() == GLEW_OK);
+		}
+#endif
 
 		glEnable(GL_DEPTH_TEST); // Depth Testing
     	glDepthFunc(GL_LEQUAL);
@@ -54,6 +165,19 @@ Window::~Window(){
     glfwDestroyWindow(win_ptr);
 }
 
+GLFWwindow* Window::shared_context(){
+	for(const auto& win : Manager::windows){
+		if(win.second->win_ptr != NULL)
+			return win.second->win_ptr;
+	}
+	return NULL;
+}
+
+void Window::make_current(){
+	if(glfwGetCurrentContext() != win_ptr)
+		glfwMakeContextCurrent(win_ptr);
+}
+
 void Window::add_control_func(GLFWkeyfun controls){
     if(win_ptr!=NULL){
         glfwMakeContextCurrent(win_ptr);
@@ -75,38 +199,101 @@ bool Window::display(){
 
 }
 
+ImageWindow::~ImageWindow(){
+    if(win_ptr!=NULL){
+        make_current();
+        if(texture!=0)
+            glDeleteTextures(1, &texture);
+#ifndef _WIN32
+        if(pbo_[0]!=0)
+            glDeleteBuffers(2, pbo_);
+#endif
+    }
+}
+
+void ImageWindow::upload(){
+    const cv::Mat& image = *current_image;
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, (image.step & 3) ? 1 : 4);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, image.step / image.elemSize());
+
+    if(texture==0 || image.cols!=texture_width_ || image.rows!=texture_height_){
+        // immutable storage is allocated once per image size
+        if(texture!=0)
+            glDeleteTextures(1, &texture);
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        const GLenum internal_format = texture_format(image_format_, data_type_);
+#ifndef _WIN32
+        if(GLEW_ARB_texture_storage)
+            glTexStorage2D(GL_TEXTURE_2D, 1, internal_format, image.cols, image.rows);
+        else
+#endif
+            glTexImage2D(GL_TEXTURE_2D, 0, internal_format, image.cols, image.rows, 0,
+                         image_format_, data_type_, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+        texture_width_ = image.cols;
+        texture_height_ = image.rows;
+    }
+
+    const void* pixels = image.ptr();
+#ifndef _WIN32
+    const size_t bytes = image.step * (image.rows - 1) + image.cols * image.elemSize();
+    if(GLEW_ARB_pixel_buffer_object){
+        if(pbo_[0]==0)
+            glGenBuffers(2, pbo_);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo_[next_pbo_]);
+        next_pbo_ ^= 1;
+        // orphaned, so mapping does not wait for a transfer still reading it
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+        void* mapped = glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+        if(mapped!=NULL){
+            memcpy(mapped, image.ptr(), bytes);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            // the texture is filled from the buffer, asynchronously
+            pixels = NULL;
+        } else{
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+    }
+#endif
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, image.cols, image.rows, image_format_, data_type_, pixels);
+#ifndef _WIN32
+    if(GLEW_ARB_pixel_buffer_object)
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+#endif
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
 bool ImageWindow::display(){
     if(win_ptr==NULL)
         return false;
     if(!glfwWindowShouldClose(win_ptr)){
         if(current_image==NULL)
             return true;
-        glfwMakeContextCurrent(win_ptr);
+        make_current();
+        if(dirty_){
+            upload();
+            dirty_ = false;
+        }
         GLint windowWidth, windowHeight;
         glfwGetFramebufferSize(win_ptr, &windowWidth, &windowHeight);
         glViewport(0, 0, windowWidth, windowHeight);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         glfwGetWindowSize(win_ptr, &windowWidth, &windowHeight);
+        glMatrixMode(GL_PROJECTION);
         glLoadIdentity();
         glOrtho(0, windowWidth, windowHeight, 0, -1, +1);
-        glBindTexture(GL_TEXTURE_2D, texture);
-        glPixelStorei(GL_UNPACK_ALIGNMENT, (current_image->step & 3) ? 1 : 4);
-        int height = current_image->rows;
-        int width = current_image->cols;
-        int elem_size = current_image->elemSize();
-        int stride = current_image->step/elem_size;
-        glPixelStorei(GL_UNPACK_ROW_LENGTH,stride);
-
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, stride, height, 0, image_format_, data_type_, current_image->ptr());
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
-        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
-        glBindTexture(GL_TEXTURE_2D, 0);
+        glMatrixMode(GL_MODELVIEW);
+        glLoadIdentity();
 
+        const float width = texture_width_;
+        const float height = texture_height_;
         glBindTexture(GL_TEXTURE_2D, texture);
         glEnable(GL_TEXTURE_2D);
         glBegin(GL_QUADS);
@@ -130,20 +317,146 @@ bool ImageWindow::display(){
 }
 
 void ImageWindow::set_image(std::shared_ptr<cv::Mat> image_in){
-    if(win_ptr!=NULL)
+    if(win_ptr!=NULL && image_in!=NULL && !image_in->empty()){
         current_image = image_in;
+        dirty_ = true;
+    }
 }
 
-ObjectWindow::ObjectWindow(std::string name, int resX, int resY):
-Window(name,resX,resY),
+ObjectWindow::ObjectWindow(std::string name, int resX, int resY, bool visible):
+Window(name,resX,resY,visible),
 eye(Eigen::Vector3d(0,40,40)),
-gaze(Eigen::Vector3d(0,0,0)){}
+gaze(Eigen::Vector3d(0,0,0)),
+up(Eigen::Vector3d(0,1,0)),
+ortho_extent(0),
+offscreen_width_(0),
+offscreen_height_(0),
+framebuffer_(0),
+color_buffer_(0),
+depth_buffer_(0),
+capture_requested_(false),
+next_capture_(0){
+	for(int i = 0; i < 2; ++i){
+		capture_pbo_[i] = 0;
+		capture_pending_[i] = false;
+		capture_width_[i] = capture_height_[i] = 0;
+	}
+}
 
 
 ObjectWindow::~ObjectWindow(){
 	for(const auto obj : objects){
 		obj.second->windows.erase(name_);
 	}
+#ifndef _WIN32
+	if(win_ptr!=NULL){
+		make_current();
+		if(framebuffer_!=0){
+			glDeleteFramebuffers(1, &framebuffer_);
+			glDeleteRenderbuffers(1, &color_buffer_);
+			glDeleteRenderbuffers(1, &depth_buffer_);
+		}
+		if(capture_pbo_[0]!=0)
+			glDeleteBuffers(2, capture_pbo_);
+	}
+#endif
+}
+
+bool ObjectWindow::set_offscreen(int width, int height){
+#ifndef _WIN32
+	if(win_ptr==NULL || !GLEW_ARB_framebuffer_object)
+		return false;
+	make_current();
+	if(framebuffer_==0){
+		glGenFramebuffers(1, &framebuffer_);
+		glGenRenderbuffers(1, &color_buffer_);
+		glGenRenderbuffers(1, &depth_buffer_);
+	}
+	glBindRenderbuffer(GL_RENDERBUFFER, color_buffer_);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, depth_buffer_);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color_buffer_);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth_buffer_);
+	const bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	if(!complete)
+		return false;
+	offscreen_width_ = width;
+	offscreen_height_ = height;
+	return true;
+#else
+	(void)width;
+	(void)height;
+	return false;
+#endif
+}
+
+void ObjectWindow::capture(){
+#ifndef _WIN32
+	capture_requested_ = true;
+#endif
+}
+
+void ObjectWindow::read_back(int width, int height){
+#ifndef _WIN32
+	const int current = next_capture_;
+	if(capture_requested_ && GLEW_ARB_pixel_buffer_object){
+		if(capture_pbo_[0]==0)
+			glGenBuffers(2, capture_pbo_);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, capture_pbo_[current]);
+		if(width!=capture_width_[current] || height!=capture_height_[current])
+			glBufferData(GL_PIXEL_PACK_BUFFER, size_t(width) * height * 3, NULL, GL_STREAM_READ);
+		glReadBuffer(framebuffer_!=0 ? GL_COLOR_ATTACHMENT0 : GL_BACK);
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		// returns right away, the pixels are copied into the buffer later
+		glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, 0);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		capture_width_[current] = width;
+		capture_height_[current] = height;
+		capture_pending_[current] = true;
+		next_capture_ = current ^ 1;
+	}
+	capture_requested_ = false;
+	// the readback started a frame ago is done by now
+	if(capture_pending_[current ^ 1])
+		deliver(current ^ 1);
+#else
+	(void)width;
+	(void)height;
+#endif
+}
+
+void ObjectWindow::deliver(int index){
+#ifndef _WIN32
+	capture_pending_[index] = false;
+	const size_t bytes = size_t(capture_width_[index]) * capture_height_[index] * 3;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, capture_pbo_[index]);
+	const void* mapped = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+	if(mapped!=NULL){
+		std::vector<unsigned char> rgb(static_cast<const unsigned char*>(mapped),
+		                               static_cast<const unsigned char*>(mapped) + bytes);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		if(on_capture)
+			on_capture(capture_width_[index], capture_height_[index], rgb);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+#else
+	(void)index;
+#endif
+}
+
+void ObjectWindow::finish_capture(){
+	if(win_ptr==NULL)
+		return;
+	make_current();
+	for(int i = 0; i < 2; ++i){
+		const int index = next_capture_ ^ i;  // oldest first
+		if(capture_pending_[index])
+			deliver(index);
+	}
 }
 
 
@@ -151,34 +464,50 @@ bool ObjectWindow::display(){
 	if(win_ptr==NULL)
 		return false;
 	if(!glfwWindowShouldClose(win_ptr)){
-		glfwMakeContextCurrent(win_ptr);
+		make_current();
 		GLint windowWidth, windowHeight;
 		glfwGetFramebufferSize(win_ptr, &windowWidth, &windowHeight);
+#ifndef _WIN32
+		if(framebuffer_!=0){
+			glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+			windowWidth = offscreen_width_;
+			windowHeight = offscreen_height_;
+		}
+#endif
 		glViewport(0, 0, windowWidth, windowHeight);
 
 		// Draw stuff
 		glClearColor(0.0, 0.3, 0.8, 1.0);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-		glMatrixMode(GL_MODELVIEW_MATRIX);
-
-		gluLookAt(eye.x(),eye.y(),eye.z(),  // eye  
-		gaze.x(), gaze.y(), gaze.z(),      // center  
-		0.0, 1.0, 0.);      // up direction
-
-		for(const auto obj : objects){
-			obj.second->display();
+		// the matrices are composed here, so nothing is read back from GL
+		const Eigen::Matrix4d projection = ortho_extent > 0 ?
+			orthographic(ortho_extent, windowWidth, windowHeight, -1000, 1000) :
+			perspective(90, (double)windowHeight / (double)windowWidth, .01, 100);
+		const Eigen::Matrix4d view = look_at(eye, gaze, up);
+		glMatrixMode(GL_PROJECTION);
+		glLoadMatrixd(projection.data());
+		glMatrixMode(GL_MODELVIEW);
+
+		// state shared by all objects. The scene first, then the overlays on top
+		glDisable(GL_LIGHTING);
+		glEnableClientState(GL_VERTEX_ARRAY);
+		for(int pass = 0; pass < 2; pass++){
+			for(const auto& obj : objects){
+				if(obj.second->overlay == (pass == 1))
+					obj.second->display(view, projection, windowWidth, windowHeight);
+			}
 		}
-
-		glMatrixMode(GL_PROJECTION_MATRIX);
-		glLoadIdentity();
-
-
-
-		gluPerspective( 90, (double)windowHeight / (double)windowWidth, .01, 100 );
-
-
-
+		glDisableClientState(GL_VERTEX_ARRAY);
+		read_back(windowWidth, windowHeight);
+
+#ifndef _WIN32
+		if(framebuffer_!=0){
+			// nothing to show, and no waiting for the swap
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			return true;
+		}
+#endif
 		// Update Screen
 		glfwSwapBuffers(win_ptr);
 		//keyboard_control();
@@ -208,7 +537,11 @@ void ObjectWindow::add_object(Object* obj){
 Object::Object(std::string name):
 pose(Eigen::Affine3d::Identity()),
 draw(true),
-name_(name){
+name_(name),
+overlay(false),
+clip_(Eigen::Matrix4d::Identity()),
+viewport_width_(0),
+viewport_height_(0){
 }
 
 Object::~Object(){
@@ -221,14 +554,14 @@ void Object::del(){
 	}
 }
 
-void Object::display(){
-	glPushMatrix();
-	Eigen::Matrix4d scene_mat;
-	glGetDoublev(GL_MODELVIEW_MATRIX, scene_mat.data());
-	scene_mat = scene_mat*pose.matrix();
-	glLoadMatrixd(scene_mat.data());
+void Object::display(const Eigen::Matrix4d& view, const Eigen::Matrix4d& projection,
+                     int viewport_width, int viewport_height){
+	const Eigen::Matrix4d modelview = view*pose.matrix();
+	clip_ = projection*modelview;
+	viewport_width_ = viewport_width;
+	viewport_height_ = viewport_height;
+	glLoadMatrixd(modelview.data());
 	draw_obj();
-	glPopMatrix();
 }
 
 void Object::draw_obj(){
@@ -247,161 +580,382 @@ void Object::rotate(Eigen::Quaterniond q){
 	pose = q*pose;
 }
 
-void Cube::draw_obj(){
+StaticMesh::~StaticMesh(){
+#ifndef _WIN32
+    if(buffer_ != 0 && glfwGetCurrentContext() != NULL)
+        glDeleteBuffers(1, &buffer_);
+#endif
+}
 
-    glDisable(GL_LIGHTING);
-    glBegin(GL_QUADS);
-
-    // top
-    glColor3f(1.0f, 0.0f, 0.0f);
-    glNormal3f(0.0f, 1.0f, 0.0f);
-    glVertex3f(-hWidth, hHeight, hLength);
-    glVertex3f(hWidth, hHeight, hLength);
-    glVertex3f(hWidth, hHeight, -hLength);
-    glVertex3f(-hWidth, hHeight, -hLength);
- 
-    // front
-    glColor3f(0.0f, 1.0f, 0.0f);
-    glNormal3f(0.0f, 0.0f, 1.0f);
-    glVertex3f(hWidth, -hHeight, hLength);
-    glVertex3f(hWidth, hHeight, hLength);
-    glVertex3f(-hWidth, hHeight, hLength);
-    glVertex3f(-hWidth, -hHeight, hLength);
- 
-    // right
-    glColor3f(0.0f, 0.0f, 1.0f);
-    glNormal3f(1.0f, 0.0f, 0.0f);
-    glVertex3f(hWidth, hHeight, -hLength);
-    glVertex3f(hWidth, hHeight, hLength);
-    glVertex3f(hWidth, -hHeight, hLength);
-    glVertex3f(hWidth, -hHeight, -hLength);
- 
-    // left
-    glColor3f(0.0f, 0.0f, 0.5f);
-    glNormal3f(-1.0f, 0.0f, 0.0f);
-    glVertex3f(-hWidth, -hHeight, hLength);
-    glVertex3f(-hWidth, hHeight, hLength);
-    glVertex3f(-hWidth, hHeight, -hLength);
-    glVertex3f(-hWidth, -hHeight, -hLength);
-
-    // bottom
-    glColor3f(0.5f, 0.0f, 0.0f);
-    glNormal3f(0.0f, -1.0f, 0.0f);
-    glVertex3f(-hWidth, -hHeight, hLength);
-    glVertex3f(hWidth, -hHeight, hLength);
-    glVertex3f(hWidth, -hHeight, -hLength);
-    glVertex3f(-hWidth, -hHeight, -hLength);
- 
-    // back
-    glColor3f(0.0f, 0.5f, 0.0f);
-    glNormal3f(0.0f, 0.0f, -1.0f);
-    glVertex3f(hWidth, hHeight, -hLength);
-    glVertex3f(hWidth, -hHeight, -hLength);
-    glVertex3f(-hWidth, -hHeight, -hLength);
-    glVertex3f(-hWidth, hHeight, -hLength);
- 
-    glEnd();
-
-    glEnable(GL_LIGHTING);
+void StaticMesh::begin(GLenum mode, float size){
+    Batch batch;
+    batch.mode = mode;
+    batch.first = data_.size() / 6;
+    batch.count = 0;
+    batch.size = size;
+    batches_.push_back(batch);
+}
 
+void StaticMesh::vertex(float x, float y, float z, float r, float g, float b){
+    const float v[6] = {x, y, z, r, g, b};
+    data_.insert(data_.end(), v, v + 6);
+    batches_.back().count++;
 }
 
+void StaticMesh::draw(){
+    const GLsizei stride = 6 * sizeof(float);
+    const float* base = data_.data();
+#ifndef _WIN32
+    if(buffer_ == 0){
+        glGenBuffers(1, &buffer_);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer_);
+        glBufferData(GL_ARRAY_BUFFER, data_.size() * sizeof(float), data_.data(), GL_STATIC_DRAW);
+    }else{
+        glBindBuffer(GL_ARRAY_BUFFER, buffer_);
+    }
+    base = NULL;
+#endif
+    glEnableClientState(GL_COLOR_ARRAY);
+    glVertexPointer(3, GL_FLOAT, stride, base);
+    glColorPointer(3, GL_FLOAT, stride, base + 3);
+    for(const auto& batch : batches_){
+        if(batch.mode == GL_POINTS)
+            glPointSize(batch.size);
+        else if(batch.size != 1.0f)
+            glLineWidth(batch.size);
+        glDrawArrays(batch.mode, batch.first, batch.count);
+        if(batch.mode == GL_POINTS)
+            glPointSize(1);
+        else if(batch.size != 1.0f)
+            glLineWidth(1);
+    }
+    glDisableClientState(GL_COLOR_ARRAY);
+#ifndef _WIN32
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+#endif
+}
 
-void Grid::draw_obj()
-{
-    // disable lighting
-    glDisable(GL_LIGHTING);
-
-    glBegin(GL_LINES);
-
-    glColor3f(0.3f, 0.3f, 0.3f);
-    for(float i=step; i <= size; i+= step)
-    {
-        glVertex3f(-size, 0,  i);   // lines parallel to X-axis
-        glVertex3f( size, 0,  i);
-        glVertex3f(-size, 0, -i);   // lines parallel to X-axis
-        glVertex3f( size, 0, -i);
-
-        glVertex3f( i, 0, -size);   // lines parallel to Z-axis
-        glVertex3f( i, 0,  size);
-        glVertex3f(-i, 0, -size);   // lines parallel to Z-axis
-        glVertex3f(-i, 0,  size);
+void Cube::draw_obj(){
+    if(mesh.empty()){
+        const float x = hWidth, y = hHeight, z = hLength;
+        mesh.begin(GL_QUADS);
+        // top
+        mesh.vertex(-x, y, z, 1.0f, 0.0f, 0.0f);
+        mesh.vertex( x, y, z, 1.0f, 0.0f, 0.0f);
+        mesh.vertex( x, y,-z, 1.0f, 0.0f, 0.0f);
+        mesh.vertex(-x, y,-z, 1.0f, 0.0f, 0.0f);
+        // front
+        mesh.vertex( x,-y, z, 0.0f, 1.0f, 0.0f);
+        mesh.vertex( x, y, z, 0.0f, 1.0f, 0.0f);
+        mesh.vertex(-x, y, z, 0.0f, 1.0f, 0.0f);
+        mesh.vertex(-x,-y, z, 0.0f, 1.0f, 0.0f);
+        // right
+        mesh.vertex( x, y,-z, 0.0f, 0.0f, 1.0f);
+        mesh.vertex( x, y, z, 0.0f, 0.0f, 1.0f);
+        mesh.vertex( x,-y, z, 0.0f, 0.0f, 1.0f);
+        mesh.vertex( x,-y,-z, 0.0f, 0.0f, 1.0f);
+        // left
+        mesh.vertex(-x,-y, z, 0.0f, 0.0f, 0.5f);
+        mesh.vertex(-x, y, z, 0.0f, 0.0f, 0.5f);
+        mesh.vertex(-x, y,-z, 0.0f, 0.0f, 0.5f);
+        mesh.vertex(-x,-y,-z, 0.0f, 0.0f, 0.5f);
+        // bottom
+        mesh.vertex(-x,-y, z, 0.5f, 0.0f, 0.0f);
+        mesh.vertex( x,-y, z, 0.5f, 0.0f, 0.0f);
+        mesh.vertex( x,-y,-z, 0.5f, 0.0f, 0.0f);
+        mesh.vertex(-x,-y,-z, 0.5f, 0.0f, 0.0f);
+        // back
+        mesh.vertex( x, y,-z, 0.0f, 0.5f, 0.0f);
+        mesh.vertex( x,-y,-z, 0.0f, 0.5f, 0.0f);
+        mesh.vertex(-x,-y,-z, 0.0f, 0.5f, 0.0f);
+        mesh.vertex(-x, y,-z, 0.0f, 0.5f, 0.0f);
     }
+    mesh.draw();
+}
 
-    // x-axis
-    glColor3f(0.5f, 0, 0);
-    glVertex3f(-size, 0, 0);
-    glVertex3f( size, 0, 0);
 
-    // z-axis
-    glColor3f(0,0,0.5f);
-    glVertex3f(0, 0, -size);
-    glVertex3f(0, 0,  size);
+void Grid::draw_obj()
+{
+    if(mesh.empty()){
+        mesh.begin(GL_LINES);
+        for(float i=step; i <= size; i+= step)
+        {
+            mesh.vertex(-size, 0,  i, 0.3f, 0.3f, 0.3f);   // lines parallel to X-axis
+            mesh.vertex( size, 0,  i, 0.3f, 0.3f, 0.3f);
+            mesh.vertex(-size, 0, -i, 0.3f, 0.3f, 0.3f);   // lines parallel to X-axis
+            mesh.vertex( size, 0, -i, 0.3f, 0.3f, 0.3f);
+
+            mesh.vertex( i, 0, -size, 0.3f, 0.3f, 0.3f);   // lines parallel to Z-axis
+            mesh.vertex( i, 0,  size, 0.3f, 0.3f, 0.3f);
+            mesh.vertex(-i, 0, -size, 0.3f, 0.3f, 0.3f);   // lines parallel to Z-axis
+            mesh.vertex(-i, 0,  size, 0.3f, 0.3f, 0.3f);
+        }
 
-    glEnd();
+        // x-axis
+        mesh.vertex(-size, 0, 0, 0.5f, 0, 0);
+        mesh.vertex( size, 0, 0, 0.5f, 0, 0);
 
-    // enable lighting back
-    glEnable(GL_LIGHTING);
+        // z-axis
+        mesh.vertex(0, 0, -size, 0, 0, 0.5f);
+        mesh.vertex(0, 0,  size, 0, 0, 0.5f);
+    }
+    mesh.draw();
 }
 
 
 void Axis::draw_obj()
 {
-    glDepthFunc(GL_ALWAYS);   
-    glDisable(GL_LIGHTING);
-    glPushMatrix();             
-
-    // draw axis
-    glLineWidth(3);
-    glBegin(GL_LINES);
-        glColor3f(1, 0, 0);
-        glVertex3f(0, 0, 0);
-        glVertex3f(size, 0, 0);
-        glColor3f(0, 1, 0);
-        glVertex3f(0, 0, 0);
-        glVertex3f(0, size, 0);
-        glColor3f(0, 0, 1);
-        glVertex3f(0, 0, 0);
-        glVertex3f(0, 0, size);
-    glEnd();
-    glLineWidth(1);
-
-    // draw endpoints
-    glPointSize(5);
-    glBegin(GL_POINTS);
-        glColor3f(1, 0, 0);
-        glVertex3f(size, 0, 0);
-        glColor3f(0, 1, 0);
-        glVertex3f(0, size, 0);
-        glColor3f(0, 0, 1);
-        glVertex3f(0, 0, size);
-    glEnd();
-    glPointSize(1);
-
-    // restore default settings
-    glPopMatrix();
-    glEnable(GL_LIGHTING);
+    if(mesh.empty()){
+        // axis
+        mesh.begin(GL_LINES, 3);
+        mesh.vertex(0, 0, 0, 1, 0, 0);
+        mesh.vertex(size, 0, 0, 1, 0, 0);
+        mesh.vertex(0, 0, 0, 0, 1, 0);
+        mesh.vertex(0, size, 0, 0, 1, 0);
+        mesh.vertex(0, 0, 0, 0, 0, 1);
+        mesh.vertex(0, 0, size, 0, 0, 1);
+        // endpoints
+        mesh.begin(GL_POINTS, 5);
+        mesh.vertex(size, 0, 0, 1, 0, 0);
+        mesh.vertex(0, size, 0, 0, 1, 0);
+        mesh.vertex(0, 0, size, 0, 0, 1);
+    }
+    glDepthFunc(GL_ALWAYS);
+    mesh.draw();
     glDepthFunc(GL_LEQUAL);
 }
 
+Path::~Path(){
+#ifndef _WIN32
+    // buffers are gone with the last context of the share group
+    if(glfwGetCurrentContext() != NULL){
+        for(const auto& chunk : chunks_){
+            if(chunk.buffer != 0)
+                released_.push_back(chunk.buffer);
+        }
+        if(!released_.empty())
+            glDeleteBuffers(released_.size(), released_.data());
+    }
+#endif
+}
+
+void Path::add_node(Eigen::Vector3d node){
+    const Eigen::Vector3f v = node.cast<float>();
+    if(chunks_.empty() || chunks_.back().vertices.size() == 3 * chunk_nodes){
+        Chunk chunk;
+        chunk.vertices.reserve(3 * chunk_nodes);
+        chunk.buffer = 0;
+        chunk.uploaded = 0;
+        if(!chunks_.empty()){
+            const float* last = &chunks_.back().vertices[3 * (chunk_nodes - 1)];
+            chunk.vertices.insert(chunk.vertices.end(), last, last + 3);
+            chunk.min = chunk.max = Eigen::Vector3f(last[0], last[1], last[2]);
+        }else{
+            chunk.min = chunk.max = v;
+        }
+        chunks_.push_back(chunk);
+    }
+    Chunk& chunk = chunks_.back();
+    chunk.vertices.push_back(v.x());
+    chunk.vertices.push_back(v.y());
+    chunk.vertices.push_back(v.z());
+    chunk.min = chunk.min.cwiseMin(v);
+    chunk.max = chunk.max.cwiseMax(v);
+    size_++;
+}
+
+void Path::set_nodes(const std::vector<Eigen::Vector3d>& nodes){
+    clear();
+    for(const auto& node : nodes)
+        add_node(node);
+}
+
+void Path::clear(){
+    for(const auto& chunk : chunks_){
+        if(chunk.buffer != 0)
+            released_.push_back(chunk.buffer);
+    }
+    chunks_.clear();
+    size_ = 0;
+}
+
+bool Path::visible(const Chunk& chunk, const Eigen::Matrix4f& mvp) const{
+    return box_visible(chunk.min, chunk.max, mvp);
+}
+
 void Path::draw_obj()
 {
-    // disable lighting
-    glDisable(GL_LIGHTING);
+    glColor3f(color.x(),color.y(),color.z());
 
-    glBegin(GL_LINES);
+    const Eigen::Matrix4f mvp = clip_.cast<float>();
+#ifndef _WIN32
+    if(!released_.empty()){
+        glDeleteBuffers(released_.size(), released_.data());
+        released_.clear();
+    }
+#endif
+    for(auto& chunk : chunks_){
+        const size_t count = chunk.vertices.size() / 3;
+        if(count < 2 || !visible(chunk, mvp))
+            continue;
+#ifndef _WIN32
+        // the buffers are shared by all windows
+        if(chunk.buffer == 0){
+            glGenBuffers(1, &chunk.buffer);
+            glBindBuffer(GL_ARRAY_BUFFER, chunk.buffer);
+            glBufferData(GL_ARRAY_BUFFER, 3 * chunk_nodes * sizeof(float), NULL, GL_DYNAMIC_DRAW);
+        }else{
+            glBindBuffer(GL_ARRAY_BUFFER, chunk.buffer);
+        }
+        // only the nodes added since the last frame are uploaded
+        if(chunk.uploaded < count){
+            glBufferSubData(GL_ARRAY_BUFFER, 3 * chunk.uploaded * sizeof(float),
+                            3 * (count - chunk.uploaded) * sizeof(float),
+                            chunk.vertices.data() + 3 * chunk.uploaded);
+            chunk.uploaded = count;
+        }
+        glVertexPointer(3, GL_FLOAT, 0, NULL);
+#else
+        glVertexPointer(3, GL_FLOAT, 0, chunk.vertices.data());
+#endif
+        glDrawArrays(GL_LINE_STRIP, 0, count);
+    }
+#ifndef _WIN32
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+#endif
+}
 
-    glColor3f(color.x(),color.y(),color.z());
-    for(int i =1; i<nodes.size(); i++)
-    {
-        glVertex3f(nodes[i-1].x(),nodes[i-1].y(),nodes[i-1].z());   // lines parallel to X-axis
-        glVertex3f(nodes[i].x(),nodes[i].y(),nodes[i].z());   // lines parallel to X-axis
+void Text::set_text(const std::string& text){
+    if(text == text_)
+        return;
+    text_ = text;
+    std::vector<char> chars(text.begin(), text.end());
+    chars.push_back('\0');
+    // stb_easy_font needs about 270 bytes per character
+    vertices_.resize(300 * chars.size());
+    quads_ = stb_easy_font_print(0, 0, chars.data(), NULL, vertices_.data(), vertices_.size());
+}
+
+void Text::draw_obj(){
+    if(quads_ == 0 || viewport_width_ <= 0 || viewport_height_ <= 0)
+        return;
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    glOrtho(0, viewport_width_, viewport_height_, 0, -1, 1);
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+    glTranslatef(x, y, 0);
+    glScalef(scale, scale, 1);
+    glDisable(GL_DEPTH_TEST);
+    glColor3f(color.x(), color.y(), color.z());
+    glVertexPointer(2, GL_FLOAT, 16, vertices_.data());
+    glDrawArrays(GL_QUADS, 0, 4 * quads_);
+    glEnable(GL_DEPTH_TEST);
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+}
+
+PointCloud::~PointCloud(){
+#ifndef _WIN32
+    // buffers are gone with the last context of the share group
+    if(glfwGetCurrentContext() != NULL){
+        for(const auto buffer : buffers_){
+            if(buffer != 0)
+                glDeleteBuffers(1, &buffer);
+        }
     }
+#endif
+}
+
+void PointCloud::update(uint64_t id, const Eigen::Vector3d& point){
+    octree_.update(id, point.cast<float>());
+}
+
+void PointCloud::draw_obj()
+{
+    if(octree_.root() < 0)
+        return;
+    glColor3f(color.x(),color.y(),color.z());
+    glPointSize(point_size);
+
+    const Eigen::Matrix4f mvp = clip_.cast<float>();
+    // pixels per unit of length at clip w = 1, the rows of the view are unit vectors
+    const float pixel_scale = 0.5f * viewport_height_ * mvp.block<1,3>(1,0).norm();
+    buffers_.resize(octree_.nodes().size(), 0);
+    capacities_.resize(octree_.nodes().size(), 0);
+    draw_node(octree_.root(), mvp, pixel_scale);
+#ifndef _WIN32
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+#endif
+}
 
-    glEnd();
+void PointCloud::draw_node(int index, const Eigen::Matrix4f& mvp, float pixel_scale)
+{
+    const PointOctree::Node& node = octree_.nodes()[index];
+#ifndef _WIN32
+    if(!node.leaf() && buffers_[index] != 0){
+        // the leaf was split since it was drawn
+        glDeleteBuffers(1, &buffers_[index]);
+        buffers_[index] = 0;
+        capacities_[index] = 0;
+    }
+#endif
+    if(node.leaf() && node.size() == 0)
+        return;
+    const Eigen::Vector3f half = Eigen::Vector3f::Constant(node.half_size);
+    if(!box_visible(node.center - half, node.center + half, mvp))
+        return;
+
+    // projected diameter of the bounding sphere, unbounded if it holds the eye
+    const float w = mvp.row(3).dot(Eigen::Vector4f(node.center.x(), node.center.y(), node.center.z(), 1.0f));
+    const float radius = 1.7320508f * node.half_size;
+    const bool around_eye = w <= radius;
+    const float pixels = around_eye ? 0.0f : 2.0f * radius * pixel_scale / w;
+    if(!around_eye && pixels < 1.0f)
+        return;
+
+    if(!node.leaf()){
+        for(const int child : node.children)
+            draw_node(child, mvp, pixel_scale);
+        return;
+    }
+    size_t count = node.size();
+    if(!around_eye)
+        count = std::min(count, std::max<size_t>(1, size_t(pixels * pixels * points_per_pixel)));
+    draw_leaf(index, count);
+}
 
-    // enable lighting back
-    glEnable(GL_LIGHTING);
+void PointCloud::draw_leaf(int index, size_t count)
+{
+    const PointOctree::Node& node = octree_.nodes()[index];
+#ifndef _WIN32
+    // the buffers are shared by all windows
+    const size_t size = node.size();
+    if(buffers_[index] == 0)
+        glGenBuffers(1, &buffers_[index]);
+    glBindBuffer(GL_ARRAY_BUFFER, buffers_[index]);
+    if(capacities_[index] < size){
+        capacities_[index] = std::max(2 * capacities_[index], size);
+        glBufferData(GL_ARRAY_BUFFER, 3 * capacities_[index] * sizeof(float), NULL, GL_DYNAMIC_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, 3 * size * sizeof(float), node.points.data());
+        octree_.clear_dirty(index);
+    }
+    // only the points changed since the last frame are uploaded
+    const size_t end = std::min(node.dirty_end, size);
+    if(node.dirty_begin < end){
+        glBufferSubData(GL_ARRAY_BUFFER, 3 * node.dirty_begin * sizeof(float),
+                        3 * (end - node.dirty_begin) * sizeof(float),
+                        node.points.data() + 3 * node.dirty_begin);
+    }
+    octree_.clear_dirty(index);
+    glVertexPointer(3, GL_FLOAT, 0, NULL);
+#else
+    glVertexPointer(3, GL_FLOAT, 0, node.points.data());
+#endif
+    // points are kept in the order they came, not sorted in space, so the first ones sample the leaf
+    glDrawArrays(GL_POINTS, 0, count);
 }
 
 }//MyGUI
@@ -1,6 +1,9 @@
 #ifdef _WIN32
 	#include <Windows.h>
 	#include <gl/GLU.h>
+	#ifndef GL_BGR
+		#define GL_BGR GL_BGR_EXT
+	#endif
 #else
 	#include <GL/glew.h>
 #endif
@@ -11,9 +14,12 @@
 #include <memory>
 #include <map>
 #include <vector>
+#include <functional>
 
 #include <opencv2/core/core.hpp>
 
+#include "point_octree.hpp"
+
 
 namespace MyGUI{
 
@@ -35,6 +41,9 @@ public:
 
 	static void update();
 
+	// handles events as they arrive, for at most timeout seconds
+	static void wait_events(double timeout);
+
 };//Manager
 
 class Window{
@@ -42,7 +51,14 @@ public:
 	GLFWwindow* win_ptr;
 	std::string name_;
 
-	Window(std::string name, int resX, int resY);
+	// all windows share their buffers and textures with the first one
+	static GLFWwindow* shared_context();
+
+	// makes the context of this window current, unless it already is
+	void make_current();
+
+	// invisible windows still have a context, e.g. to draw offscreen
+	Window(std::string name, int resX, int resY, bool visible = true);
 
 	virtual ~Window();
 
@@ -64,8 +80,15 @@ public:
 
 	Eigen::Vector3d eye;
 	Eigen::Vector3d gaze;
+	Eigen::Vector3d up;
+	// world units across the smaller side of an orthographic view, 0 for a perspective one
+	double ortho_extent;
 
-	ObjectWindow(std::string name, int resX, int resY);
+	// receives the frames read back after capture(): RGB, rows bottom-up
+	typedef std::function<void(int width, int height, std::vector<unsigned char>& rgb)> CaptureCallback;
+	CaptureCallback on_capture;
+
+	ObjectWindow(std::string name, int resX, int resY, bool visible = true);
 
 	virtual ~ObjectWindow();
 
@@ -75,6 +98,36 @@ public:
 
 	void set_camera(Eigen::Vector3d eye, Eigen::Vector3d gaze);
 
+	// draws into an offscreen framebuffer of the given size instead of the
+	// window. Returns false if framebuffer objects are not supported.
+	bool set_offscreen(int width, int height);
+
+	// reads the next frame back into a pixel buffer object. It reaches
+	// on_capture one frame later, when the transfer is done, so drawing
+	// never waits for it. Not supported on Windows.
+	void capture();
+
+	// hands a frame still being read back to on_capture, waiting for it
+	void finish_capture();
+
+private:
+	// after drawing, starts the requested readback and delivers the last one
+	void read_back(int width, int height);
+
+	void deliver(int index);
+
+	int offscreen_width_;
+	int offscreen_height_;
+	GLuint framebuffer_;
+	GLuint color_buffer_;
+	GLuint depth_buffer_;
+
+	bool capture_requested_;
+	GLuint capture_pbo_[2];
+	bool capture_pending_[2];
+	int capture_width_[2];
+	int capture_height_[2];
+	int next_capture_;
 
 };//Window
 
@@ -83,8 +136,8 @@ class CameraWindow : public ObjectWindow{
 
 public:
 
-	CameraWindow(std::string name, int resX, int resY):
-	ObjectWindow(name,resX,resY){}
+	CameraWindow(std::string name, int resX, int resY, bool visible = true):
+	ObjectWindow(name,resX,resY,visible){}
 	
 
 	void keyboard_control()
@@ -116,27 +169,77 @@ public:
 
 	//Image format examples: GL_RGB, GLBGR, GL_LUMINANCE
 	//Data type examples GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT, GL_FLOAT
+	//Single channel images stay single channel on the GPU
 	ImageWindow(std::string name, int resX, int resY, GLenum image_format, GLenum data_type):
 	Window(name,resX,resY),
+	texture(0),
 	image_format_(image_format),
-	data_type_(data_type){
-		glGenTextures(1,&texture);
+	data_type_(data_type),
+	dirty_(false),
+	texture_width_(0),
+	texture_height_(0),
+	next_pbo_(0){
+		pbo_[0] = pbo_[1] = 0;
 	}
 
+	~ImageWindow();
 
+	// the image is uploaded on the next display(), and only then
 	void set_image(std::shared_ptr<cv::Mat> image_in);
 
 	bool display();
 
+private:
+	// copies the current image into the texture, through a pixel buffer
+	// object where available so the transfer does not stall the draw
+	void upload();
+
+	bool dirty_;
+	int texture_width_;
+	int texture_height_;
+	GLuint pbo_[2];  // alternated, one may still be read by the previous transfer
+	int next_pbo_;
 };
 
 
+// Geometry which does not change, uploaded once into a vertex buffer
+// and drawn as a few batches of one primitive type each
+class StaticMesh{
+public:
+	~StaticMesh();
+
+	bool empty() const { return batches_.empty(); }
+
+	// starts a batch, size is the line width or point size
+	void begin(GLenum mode, float size = 1.0f);
+
+	void vertex(float x, float y, float z, float r, float g, float b);
+
+	void draw();
+
+private:
+	struct Batch{
+		GLenum mode;
+		GLint first;
+		GLsizei count;
+		float size;
+	};
+
+	std::vector<float> data_;	// x, y, z, r, g, b per vertex
+	std::vector<Batch> batches_;
+	GLuint buffer_ = 0;
+};
+
 class Object{
 public:
+	EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
 	std::map<std::string,ObjectWindow*> windows;
 	Eigen::Affine3d pose;
 	bool draw;
 	std::string name_;
+	// drawn after all other objects of the window, e.g. text
+	bool overlay;
 
 	Object(std::string name);
 
@@ -144,7 +247,9 @@ public:
 
 	void del();
 
-	void display();
+	// view and projection of the window, composed on the CPU
+	void display(const Eigen::Matrix4d& view, const Eigen::Matrix4d& projection,
+	             int viewport_width, int viewport_height);
 
 	void set_transform(Eigen::Affine3d t);
 
@@ -154,12 +259,18 @@ public:
 
 	virtual void draw_obj();
 
+protected:
+	Eigen::Matrix4d clip_;	// object to clip coordinates while drawing, for culling
+	int viewport_width_;	// pixels, for level of detail and overlays
+	int viewport_height_;
+
 };//Object
 
 class Cube : public Object {
 public:
 	float hWidth, hHeight, hLength;
 	void draw_obj();
+	StaticMesh mesh;
 
 	Cube(std::string name, float width, float height, float length) : 
 	Object(name), hWidth(width/2), hHeight(height/2), hLength(length/2){
@@ -171,6 +282,7 @@ class Grid : public Object {
 public:
 	float size, step;
 	void draw_obj();
+	StaticMesh mesh;
 
 	Grid(std::string name, float size, float step) 
 	: Object(name),
@@ -184,6 +296,7 @@ class Axis : public Object {
 public:
 	float size;
 	void draw_obj();
+	StaticMesh mesh;
 
 	Axis(std::string name, float size) 
 	: Object(name),
@@ -195,29 +308,32 @@ public:
 
 class Path : public Object {
 public:
-	std::vector<Eigen::Vector3d> nodes;
 	Eigen::Vector3d color;
 	void draw_obj();
 
 	Path(std::string name)
-	: Object(name),
-	nodes(){
+	: Object(name){
 	}
 
 	Path(std::string name, Eigen::Vector3d color)
 	: Object(name),
-	nodes(),
 	color(color){
 	}
 
 	Path(std::string name, const std::vector<Eigen::Vector3d>& nodes)
-	: Object(name),
-	nodes(nodes){
+	: Object(name){
+		set_nodes(nodes);
 	}
 
-	void add_node(Eigen::Vector3d node){
-		nodes.push_back(node);
-	}
+	~Path();
+
+	void add_node(Eigen::Vector3d node);
+
+	void set_nodes(const std::vector<Eigen::Vector3d>& nodes);
+
+	void clear();
+
+	size_t size() const { return size_; }
 
 	void set_color(Eigen::Vector3d obj_color){
 		color = obj_color;
@@ -226,6 +342,89 @@ public:
 	void set_color(float x, float y, float z){
 		color = Eigen::Vector3d(x,y,z);
 	}
+
+private:
+	// Nodes are kept as floats in chunks of a fixed size, each drawn as one
+	// line strip from its own vertex buffer. A chunk starts with the last
+	// node of the previous one, so the strips connect.
+	static const size_t chunk_nodes = 4096;
+
+	struct Chunk{
+		std::vector<float> vertices;	// x, y, z per node
+		Eigen::Vector3f min, max;	// bounding box for culling
+		GLuint buffer;			// 0 until first drawn
+		size_t uploaded;		// nodes already in the buffer
+	};
+
+	bool visible(const Chunk& chunk, const Eigen::Matrix4f& mvp) const;
+
+	std::vector<Chunk> chunks_;
+	std::vector<GLuint> released_;	// deleted once a context is current
+	size_t size_ = 0;
+};
+
+// Text in window pixels from the top left, an overlay drawn over the scene.
+// The glyphs are quads built by stb_easy_font whenever the text changes.
+class Text : public Object {
+public:
+	Eigen::Vector3d color;
+	float x, y;
+	float scale;	// of the glyphs, 1 is about 7 pixels high
+
+	Text(std::string name, float x, float y, float scale = 2.0f)
+	: Object(name),
+	color(1.0, 1.0, 1.0),
+	x(x),
+	y(y),
+	scale(scale){
+		overlay = true;
+	}
+
+	// lines separated by '\n', ASCII only
+	void set_text(const std::string& text);
+
+	void draw_obj();
+
+private:
+	std::string text_;
+	std::vector<char> vertices_;	// stb_easy_font quads, 16 bytes per vertex
+	int quads_ = 0;
+};
+
+// Points keyed by id, e.g. landmarks, in an octree. Every leaf has its own
+// vertex buffer, updated with the points changed since it was last drawn.
+// Leaves outside the view are skipped, and a leaf covering few pixels only
+// draws as many of its points as can be told apart.
+class PointCloud : public Object {
+public:
+	Eigen::Vector3d color;
+	float point_size;
+	float points_per_pixel;	// drawn per pixel covered by a leaf
+
+	PointCloud(std::string name, Eigen::Vector3d color)
+	: Object(name),
+	color(color),
+	point_size(2.0f),
+	points_per_pixel(0.25f){
+	}
+
+	~PointCloud();
+
+	// inserts the point, or moves it if the id is known
+	void update(uint64_t id, const Eigen::Vector3d& point);
+
+	size_t size() const { return octree_.size(); }
+
+	void draw_obj();
+
+private:
+	void draw_node(int index, const Eigen::Matrix4f& mvp, float pixel_scale);
+
+	void draw_leaf(int index, size_t count);
+
+	PointOctree octree_;
+	std::vector<GLuint> buffers_;		// per node, 0 until first drawn
+	std::vector<size_t> capacities_;	// points each buffer holds
 };
 
 
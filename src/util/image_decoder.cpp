@@ -0,0 +1,362 @@
+#include "image_decoder.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <algorithm>
+
+#include <opencv2/highgui/highgui.hpp>
+
+#ifdef __SSE2__
+	#include <emmintrin.h>
+#endif
+
+// decoding at reduced resolution came with OpenCV 3.2
+#if CV_MAJOR_VERSION > 3 || (CV_MAJOR_VERSION == 3 && CV_MINOR_VERSION >= 2)
+	#define HAVE_IMREAD_REDUCED 1
+#endif
+
+namespace{
+
+    ///
+    /// stb_image allocates its working and output buffers for every image.
+    /// These are served from a per thread free list, which settles after the
+    /// first frames since all frames of a sequence need the same buffers.
+    ///
+    struct ScratchHeader{
+        size_t capacity;
+        size_t padding;  // keeps the returned memory 16 byte aligned
+    };
+
+    struct ScratchCache{
+        std::vector<ScratchHeader*> free_blocks;
+        ~ScratchCache(){
+            for(auto block : free_blocks)
+                free(block);
+        }
+    };
+
+    thread_local ScratchCache scratch_cache;
+    const size_t kMaxScratchBlocks = 32;
+
+    void* scratch_malloc(size_t size){
+        auto& blocks = scratch_cache.free_blocks;
+        size_t best = blocks.size();
+        for(size_t i = 0; i < blocks.size(); i++){
+            if(blocks[i]->capacity >= size &&
+               (best == blocks.size() || blocks[i]->capacity < blocks[best]->capacity))
+                best = i;
+        }
+        ScratchHeader* block;
+        if(best < blocks.size()){
+            block = blocks[best];
+            blocks[best] = blocks.back();
+            blocks.pop_back();
+        }else{
+            block = (ScratchHeader*)malloc(sizeof(ScratchHeader) + size);
+            if(block == NULL)
+                return NULL;
+            block->capacity = size;
+        }
+        return block + 1;
+    }
+
+    void scratch_free(void* ptr){
+        if(ptr == NULL)
+            return;
+        ScratchHeader* block = (ScratchHeader*)ptr - 1;
+        auto& blocks = scratch_cache.free_blocks;
+        if(blocks.size() < kMaxScratchBlocks)
+            blocks.push_back(block);
+        else
+            free(block);
+    }
+
+    void* scratch_realloc(void* ptr, size_t size){
+        if(ptr == NULL)
+            return scratch_malloc(size);
+        ScratchHeader* block = (ScratchHeader*)ptr - 1;
+        if(block->capacity >= size)
+            return ptr;
+        void* grown = scratch_malloc(size);
+        if(grown != NULL){
+            memcpy(grown, ptr, block->capacity);
+            scratch_free(ptr);
+        }
+        return grown;
+    }
+
+}
+
+#define STB_IMAGE_IMPLEMENTATION
+#define STBI_NO_STDIO
+#define STBI_ONLY_PNG
+#define STBI_ONLY_JPEG
+#define STBI_ONLY_BMP
+#define STBI_ONLY_PNM
+#define STBI_ONLY_TGA
+#define STBI_MALLOC(sz)     scratch_malloc(sz)
+#define STBI_REALLOC(p,sz)  scratch_realloc(p,sz)
+#define STBI_FREE(p)        scratch_free(p)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+#if defined(__GNUC__) && __GNUC__ >= 6
+#pragma GCC diagnostic ignored "-Wmisleading-indentation"
+#endif
+#include "../third_party/stb_image.h"
+#pragma GCC diagnostic pop
+
+namespace{
+
+    std::atomic<int> default_backend(ImageDecoder::kOpenCV);
+
+    thread_local std::vector<char> file_buffer;
+
+    bool is_png(const char* data, size_t size){
+        return size >= 4 && memcmp(data, "\x89PNG", 4) == 0;
+    }
+
+    bool is_jpeg(const char* data, size_t size){
+        return size >= 2 && (unsigned char)data[0] == 0xFF && (unsigned char)data[1] == 0xD8;
+    }
+
+    cv::Mat decode_stb(const char* data, size_t size){
+        int cols, rows, channels;
+        unsigned char* pixels = stbi_load_from_memory(
+            (const unsigned char*)data, (int)size, &cols, &rows, &channels, 1);
+        if(pixels == NULL)
+            return cv::Mat();
+        cv::Mat image = FramePool::instance().acquire(rows, cols, CV_8UC1);
+        for(int r = 0; r < rows; ++r)
+            memcpy(image.ptr(r), pixels + (size_t)r * cols, cols);
+        stbi_image_free(pixels);
+        return image;
+    }
+
+    cv::Mat decode_opencv(const char* data, size_t size, int reduction, bool& reduced){
+        const cv::Mat buffer(1, (int)size, CV_8UC1, (void*)data);
+#ifdef HAVE_IMREAD_REDUCED
+        // libjpeg scales while decoding, which is where the time is saved
+        if(reduction > 1 && is_jpeg(data, size)){
+            const int flag = reduction == 2 ? cv::IMREAD_REDUCED_GRAYSCALE_2 :
+                             reduction == 4 ? cv::IMREAD_REDUCED_GRAYSCALE_4 :
+                                              cv::IMREAD_REDUCED_GRAYSCALE_8;
+            cv::Mat image = cv::imdecode(buffer, flag);
+            if(image.empty())
+                return image;
+            reduced = true;
+            // libjpeg rounds up, binning down
+            int cols, rows, channels;
+            if(stbi_info_from_memory((const unsigned char*)data, (int)size, &cols, &rows, &channels))
+                image = image(cv::Rect(0, 0, std::min(image.cols, cols / reduction),
+                                       std::min(image.rows, rows / reduction)));
+            return image;
+        }
+#endif
+        // with a buffer of the right size imdecode decodes in place
+        int cols, rows, channels;
+        if(stbi_info_from_memory((const unsigned char*)data, (int)size, &cols, &rows, &channels)){
+            cv::Mat image = FramePool::instance().acquire(rows, cols, CV_8UC1);
+            cv::imdecode(buffer, cv::IMREAD_GRAYSCALE, &image);
+            return image;
+        }
+        return cv::imdecode(buffer, cv::IMREAD_GRAYSCALE);
+    }
+
+}
+
+///
+/// Takes the buffers of new Mats from the pool and gives them back when
+/// OpenCV releases the last reference, on whichever thread that happens.
+///
+class FramePool::Allocator : public cv::MatAllocator
+{
+public:
+    explicit Allocator(FramePool& pool) : pool_(pool) {}
+
+#if CV_MAJOR_VERSION >= 3
+    #if CV_MAJOR_VERSION >= 4
+    typedef cv::AccessFlag AccessFlags;
+    #else
+    typedef int AccessFlags;
+    #endif
+
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+                           AccessFlags, cv::UMatUsageFlags) const{
+        const size_t bytes = total(dims, sizes, type, step);
+        cv::UMatData* u = new cv::UMatData(this);
+        u->data = u->origdata = data ? (uchar*)data : pool_.take(bytes);
+        u->size = bytes;
+        if(data)
+            u->flags |= cv::UMatData::USER_ALLOCATED;
+        return u;
+    }
+
+    bool allocate(cv::UMatData* u, AccessFlags, cv::UMatUsageFlags) const{
+        return u != NULL;
+    }
+
+    void deallocate(cv::UMatData* u) const{
+        if(u == NULL)
+            return;
+        if(!(u->flags & cv::UMatData::USER_ALLOCATED))
+            pool_.give_back(u->origdata, u->size);
+        delete u;
+    }
+#else
+    // the reference count follows the pixels, as with OpenCV's own allocation
+    void allocate(int dims, const int* sizes, int type, int*& refcount,
+                  uchar*& datastart, uchar*& data, size_t* step){
+        const size_t bytes = (total(dims, sizes, type, step) + sizeof(int) - 1) / sizeof(int) * sizeof(int);
+        data = datastart = pool_.take(bytes + sizeof(int));
+        refcount = (int*)(data + bytes);
+        *refcount = 1;
+    }
+
+    void deallocate(int* refcount, uchar* datastart, uchar*){
+        pool_.give_back(datastart, (uchar*)refcount - datastart + sizeof(int));
+    }
+#endif
+
+private:
+    static size_t total(int dims, const int* sizes, int type, size_t* step){
+        size_t bytes = CV_ELEM_SIZE(type);
+        for(int i = dims - 1; i >= 0; i--){
+            if(step)
+                step[i] = bytes;
+            bytes *= sizes[i];
+        }
+        return bytes;
+    }
+
+    FramePool& pool_;
+};
+
+FramePool::FramePool(size_t max_buffers):
+max_buffers_(max_buffers),
+allocated_(0),
+num_free_(0),
+allocator_(new Allocator(*this))
+{
+}
+
+FramePool& FramePool::instance(){
+    // never destroyed, frames may be released after main returned
+    static FramePool* pool = new FramePool(512);
+    return *pool;
+}
+
+cv::Mat FramePool::acquire(int rows, int cols, int type){
+    cv::Mat buffer;
+    buffer.allocator = allocator_.get();
+    buffer.create(rows, cols, type);
+    return buffer;
+}
+
+unsigned char* FramePool::take(size_t bytes){
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<unsigned char*>& buffers = free_[bytes];
+        if(!buffers.empty()){
+            unsigned char* data = buffers.back();
+            buffers.pop_back();
+            num_free_--;
+            return data;
+        }
+        allocated_++;
+    }
+    return (unsigned char*)cv::fastMalloc(bytes);
+}
+
+void FramePool::give_back(unsigned char* data, size_t bytes){
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(num_free_ < max_buffers_){
+            free_[bytes].push_back(data);
+            num_free_++;
+            return;
+        }
+        allocated_--;
+    }
+    cv::fastFree(data);
+}
+
+size_t FramePool::size(){
+    std::lock_guard<std::mutex> lock(mutex_);
+    return allocated_;
+}
+
+namespace ImageDecoder{
+
+    void set_default_backend(Backend backend){
+        default_backend = backend;
+    }
+
+    cv::Mat decode(const char* data, size_t size, int reduction){
+        cv::Mat image;
+        const bool stb_first = !(is_png(data, size) || is_jpeg(data, size)) ||
+                               default_backend == kStb;
+        if(stb_first)
+            image = decode_stb(data, size);
+        bool reduced = false;
+        if(image.empty())
+            image = decode_opencv(data, size, reduction, reduced);
+        // whatever was not reduced while decoding is binned
+        for(int r = reduced ? 1 : reduction; r > 1 && !image.empty(); r /= 2)
+            image = bin2x2(image);
+        return image;
+    }
+
+    cv::Mat bin2x2(const cv::Mat& image){
+        const int rows = image.rows / 2;
+        const int cols = image.cols / 2;
+        cv::Mat binned = FramePool::instance().acquire(rows, cols, CV_8UC1);
+        for(int r = 0; r < rows; ++r){
+            const unsigned char* row0 = image.ptr(2 * r);
+            const unsigned char* row1 = image.ptr(2 * r + 1);
+            unsigned char* out = binned.ptr(r);
+            int c = 0;
+#ifdef __SSE2__
+            const __m128i mask = _mm_set1_epi16(0x00FF);
+            const __m128i two = _mm_set1_epi16(2);
+            for(; c + 16 <= cols; c += 16){
+                // 16 bit sums of the even and odd pixels of both rows
+                const __m128i a0 = _mm_loadu_si128((const __m128i*)(row0 + 2 * c));
+                const __m128i a1 = _mm_loadu_si128((const __m128i*)(row0 + 2 * c + 16));
+                const __m128i b0 = _mm_loadu_si128((const __m128i*)(row1 + 2 * c));
+                const __m128i b1 = _mm_loadu_si128((const __m128i*)(row1 + 2 * c + 16));
+                __m128i s0 = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(a0, mask), _mm_srli_epi16(a0, 8)),
+                                           _mm_add_epi16(_mm_and_si128(b0, mask), _mm_srli_epi16(b0, 8)));
+                __m128i s1 = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(a1, mask), _mm_srli_epi16(a1, 8)),
+                                           _mm_add_epi16(_mm_and_si128(b1, mask), _mm_srli_epi16(b1, 8)));
+                s0 = _mm_srli_epi16(_mm_add_epi16(s0, two), 2);
+                s1 = _mm_srli_epi16(_mm_add_epi16(s1, two), 2);
+                _mm_storeu_si128((__m128i*)(out + c), _mm_packus_epi16(s0, s1));
+            }
+#endif
+            for(; c < cols; ++c){
+                out[c] = (unsigned char)((row0[2 * c] + row0[2 * c + 1] +
+                                          row1[2 * c] + row1[2 * c + 1] + 2) >> 2);
+            }
+        }
+        return binned;
+    }
+
+    cv::Mat decode_file(const std::string& filename, int reduction){
+        FILE* file = fopen(filename.c_str(), "rb");
+        if(file == NULL)
+            return cv::Mat();
+        fseek(file, 0, SEEK_END);
+        const long size = ftell(file);
+        fseek(file, 0, SEEK_SET);
+        // the read buffer is reused by every frame this thread decodes
+        file_buffer.resize(size > 0 ? size : 0);
+        const bool ok = size > 0 && fread(file_buffer.data(), 1, size, file) == (size_t)size;
+        fclose(file);
+        if(!ok)
+            return cv::Mat();
+        return decode(file_buffer.data(), file_buffer.size(), reduction);
+    }
+
+}
@@ -0,0 +1,87 @@
+#ifndef _IMAGE_DECODER_HPP_
+#define _IMAGE_DECODER_HPP_
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include <opencv2/core/core.hpp>
+
+///
+/// Recycled frame buffers which are handed out as cv::Mat. The Mats use the
+/// pool's cv::MatAllocator, so when the last reference to a frame goes away,
+/// e.g. when the estimator dropped it, OpenCV hands its buffer back to a free
+/// list of its size. Taking and returning a buffer are constant time. In
+/// steady state playback does not allocate any image memory.
+///
+class FramePool
+{
+public:
+    /// Process wide pool, shared by all decoding threads
+    static FramePool& instance();
+
+    ///
+    /// Returns a free buffer of the requested size, allocating a new one if
+    /// all buffers of that size are in use. At most max_buffers free buffers
+    /// are kept, others are released when they come back.
+    ///
+    cv::Mat acquire(int rows, int cols, int type);
+
+    /// Number of buffers allocated by the pool, in use or free
+    size_t size();
+
+private:
+    class Allocator;
+
+    explicit FramePool(size_t max_buffers);
+
+    /// Called by the allocator from any thread
+    unsigned char* take(size_t bytes);
+
+    void give_back(unsigned char* data, size_t bytes);
+
+    size_t max_buffers_;
+    size_t allocated_;
+    size_t num_free_;
+    std::map<size_t, std::vector<unsigned char*> > free_;   ///< by size in bytes
+    std::mutex mutex_;
+    std::unique_ptr<cv::MatAllocator> allocator_;
+};
+
+namespace ImageDecoder{
+
+    enum Backend{
+        kOpenCV,   ///< libpng / libjpeg through cv::imdecode, for PNG and JPEG by default
+        kStb       ///< the vendored stb_image, for BMP, PNM and TGA by default
+    };
+
+    ///
+    /// Selects the backend for PNG and JPEG files. Formats only one of the
+    /// backends handles, and files stb_image fails on (e.g. 16 bit PNG),
+    /// always go to the one which can decode them.
+    ///
+    void set_default_backend(Backend backend);
+
+    ///
+    /// Decodes an encoded image into an 8 bit grayscale FramePool buffer.
+    /// With a reduction of 2, 4 or 8 the image is downscaled by that factor
+    /// to floor(cols / reduction) x floor(rows / reduction), JPEGs already
+    /// while decoding where OpenCV supports it, anything else by binning.
+    /// Returns an empty cv::Mat on failure. Thread safe.
+    ///
+    cv::Mat decode(const char* data, size_t size, int reduction = 1);
+
+    /// Reads and decodes an image file, see decode()
+    cv::Mat decode_file(const std::string& filename, int reduction = 1);
+
+    ///
+    /// Averages 2x2 blocks of an 8 bit image into a FramePool buffer of
+    /// floor(cols / 2) x floor(rows / 2) (SSE2 where available)
+    ///
+    cv::Mat bin2x2(const cv::Mat& image);
+
+}
+
+#endif
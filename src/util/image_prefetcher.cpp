@@ -0,0 +1,107 @@
+#include "image_prefetcher.hpp"
+#include <algorithm>
+#include <exception>
+#include <limits>
+
+ImagePrefetcher::ImagePrefetcher(size_t num_frames, size_t num_cameras, DecodeFunction decode,
+                                 size_t num_workers, size_t depth):
+num_frames_(num_frames),
+num_cameras_(num_cameras),
+decode_(decode),
+slots_(std::max<size_t>(depth, 1)),
+next_task_(0),
+consumed_(0),
+stop_(false)
+{
+    for(auto& slot : slots_){
+        slot.frame = std::numeric_limits<size_t>::max();
+        slot.pending = 0;
+        slot.images.resize(num_cameras_);
+        slot.errors.resize(num_cameras_);
+    }
+    for(size_t i = 0; i < std::max<size_t>(num_workers, 1); i++){
+        workers_.emplace_back(&ImagePrefetcher::worker, this);
+    }
+}
+
+ImagePrefetcher::~ImagePrefetcher(){
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    task_cv_.notify_all();
+    for(auto& t : workers_){
+        t.join();
+    }
+}
+
+void ImagePrefetcher::worker(){
+    const size_t total = num_frames_ * num_cameras_;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while(true){
+        // only claim tasks whose frame fits into the ring buffer
+        const auto claimable = [this, total]() {
+            return stop_ || next_task_ >= total ||
+                   next_task_ / num_cameras_ < consumed_ + slots_.size();
+        };
+        task_cv_.wait(lock, claimable);
+        if(stop_ || next_task_ >= total)
+            return;
+
+        const size_t frame = next_task_ / num_cameras_;
+        const size_t cam = next_task_ % num_cameras_;
+        next_task_++;
+        Slot& slot = slots_[frame % slots_.size()];
+        if(cam == 0){
+            slot.frame = frame;
+            slot.pending = num_cameras_;
+        }
+
+        lock.unlock();
+        cv::Mat image;
+        std::string error;
+        // an exception must not end the worker, the frame stays empty
+        try{
+            image = decode_(frame, cam);
+        } catch(const std::exception& e){
+            error = e.what();
+        } catch(...){
+            error = "unknown error";
+        }
+        lock.lock();
+
+        slot.images[cam] = image;
+        slot.errors[cam].swap(error);
+        if(--slot.pending == 0)
+            ready_cv_.notify_one();
+    }
+}
+
+bool ImagePrefetcher::pop(std::vector<cv::Mat>& images, std::vector<std::string>* errors){
+    std::unique_lock<std::mutex> lock(mutex_);
+    if(consumed_ >= num_frames_)
+        return false;
+    Slot& slot = slots_[consumed_ % slots_.size()];
+    ready_cv_.wait(lock, [this, &slot]() { return slot.frame == consumed_ && slot.pending == 0; });
+    images.swap(slot.images);
+    slot.images.assign(num_cameras_, cv::Mat());
+    if(errors)
+        errors->swap(slot.errors);
+    slot.errors.assign(num_cameras_, std::string());
+    consumed_++;
+    lock.unlock();
+    task_cv_.notify_all();
+    return true;
+}
+
+size_t ImagePrefetcher::ready(){
+    std::unique_lock<std::mutex> lock(mutex_);
+    size_t count = 0;
+    for(size_t f = consumed_; f < consumed_ + slots_.size(); f++){
+        const Slot& slot = slots_[f % slots_.size()];
+        if(slot.frame != f || slot.pending != 0)
+            break;
+        count++;
+    }
+    return count;
+}
@@ -0,0 +1,63 @@
+#ifndef _IMAGE_PREFETCHER_HPP_
+#define _IMAGE_PREFETCHER_HPP_
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+#include <opencv2/core/core.hpp>
+
+///
+/// Decodes the images of a dataset ahead of the consumer on a pool of worker threads.
+/// Frames are handed out strictly in order, each frame holding one image per camera.
+/// At most depth frames are kept decoded at once (bounded ring buffer).
+/// An exception thrown by the decode function leaves an empty image.
+///
+class ImagePrefetcher
+{
+public:
+    /// Returns the decoded image of camera cam for frame index frame
+    typedef std::function<cv::Mat(size_t frame, size_t cam)> DecodeFunction;
+
+    ImagePrefetcher(size_t num_frames, size_t num_cameras, DecodeFunction decode,
+                    size_t num_workers, size_t depth);
+
+    ~ImagePrefetcher();
+
+    ///
+    /// Blocks until the next frame is decoded and moves its images out.
+    /// Returns false once all frames have been consumed. errors receives the
+    /// message of each camera whose decoding threw, empty for the others.
+    ///
+    bool pop(std::vector<cv::Mat>& images, std::vector<std::string>* errors = NULL);
+
+    /// Number of frames which are decoded and waiting to be popped
+    size_t ready();
+
+private:
+    struct Slot{
+        size_t frame;
+        size_t pending;
+        std::vector<cv::Mat> images;
+        std::vector<std::string> errors;
+    };
+
+    void worker();
+
+    size_t num_frames_;
+    size_t num_cameras_;
+    DecodeFunction decode_;
+    std::vector<Slot> slots_;
+    size_t next_task_;
+    size_t consumed_;
+    bool stop_;
+    std::mutex mutex_;
+    std::condition_variable task_cv_;
+    std::condition_variable ready_cv_;
+    std::vector<std::thread> workers_;
+};
+
+#endif
@@ -0,0 +1,47 @@
+#include "imu_reader.hpp"
+#include "mapped_file.hpp"
+#include "csv_numbers.hpp"
+
+using namespace CsvNumbers;
+
+namespace ImuReader{
+
+    bool parse(const char* begin, const char* end, std::vector<ImuSample>& samples){
+        samples.clear();
+        // rough guess of ~60 bytes per line avoids most reallocations
+        samples.reserve((end - begin) / 60 + 1);
+        const char* p = begin;
+        while(p < end){
+            const char* line_end = p;
+            while(line_end < end && *line_end != '\n')
+                line_end++;
+
+            skip_blanks(p, line_end);
+            // header, comment and empty lines
+            if(p < line_end && (is_digit(*p) || *p == '-' || *p == '+')){
+                ImuSample sample;
+                if(!parse_int(p, line_end, sample.timestamp))
+                    return false;
+                for(int j = 0; j < 3; ++j){
+                    if(!expect_separator(p, line_end) || !parse_double(p, line_end, sample.gyro[j]))
+                        return false;
+                }
+                for(int j = 0; j < 3; ++j){
+                    if(!expect_separator(p, line_end) || !parse_double(p, line_end, sample.acc[j]))
+                        return false;
+                }
+                samples.push_back(sample);
+            }
+            p = line_end + 1;
+        }
+        return true;
+    }
+
+    bool load(const std::string& filename, std::vector<ImuSample>& samples){
+        MappedFile file;
+        if(!file.open(filename))
+            return false;
+        return parse(file.data(), file.data() + file.size(), samples);
+    }
+
+}
@@ -0,0 +1,35 @@
+#ifndef _IMU_READER_HPP_
+#define _IMU_READER_HPP_
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+///
+/// One IMU measurement as stored in an ASL/EuRoC imu0/data.csv file
+///
+struct ImuSample{
+    int64_t timestamp;   ///< [ns]
+    double gyro[3];      ///< [rad/s]
+    double acc[3];       ///< [m/s^2]
+};
+
+namespace ImuReader{
+
+    ///
+    /// Parses an ASL/EuRoC IMU csv file
+    /// (timestamp [ns], w_x, w_y, w_z, a_x, a_y, a_z per line) in a single pass
+    /// over a memory mapping of the file. Comment and header lines are skipped.
+    /// Returns false if the file cannot be read or a line is malformed.
+    ///
+    bool load(const std::string& filename, std::vector<ImuSample>& samples);
+
+    ///
+    /// Parses the csv contents in [begin, end). Exposed for other containers
+    /// which embed the csv text.
+    ///
+    bool parse(const char* begin, const char* end, std::vector<ImuSample>& samples);
+
+}
+
+#endif
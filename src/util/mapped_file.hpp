@@ -0,0 +1,111 @@
+#ifndef _MAPPED_FILE_HPP_
+#define _MAPPED_FILE_HPP_
+
+#include <string>
+#include <cstddef>
+
+#ifdef _WIN32
+	#include <Windows.h>
+#else
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+///
+/// Read only memory mapping of a whole file.
+/// The mapping stays valid until close() is called or the object is destroyed.
+///
+class MappedFile
+{
+public:
+    MappedFile() : data_(NULL), size_(0) {}
+
+    explicit MappedFile(const std::string& filename) : data_(NULL), size_(0)
+    {
+        open(filename);
+    }
+
+    ~MappedFile()
+    {
+        close();
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ///
+    /// Maps the file. Returns false if it cannot be opened or mapped.
+    /// An empty file opens successfully with size() == 0.
+    ///
+    bool open(const std::string& filename)
+    {
+        close();
+#ifdef _WIN32
+        HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                                  OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if(file == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER size;
+        if(!GetFileSizeEx(file, &size)){
+            CloseHandle(file);
+            return false;
+        }
+        size_ = (size_t)size.QuadPart;
+        if(size_ > 0){
+            HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+            if(mapping != NULL){
+                data_ = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                CloseHandle(mapping);
+            }
+        }
+        CloseHandle(file);
+#else
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if(fd < 0)
+            return false;
+        struct stat st;
+        if(fstat(fd, &st) != 0){
+            ::close(fd);
+            return false;
+        }
+        size_ = (size_t)st.st_size;
+        if(size_ > 0){
+            void* ptr = mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(ptr != MAP_FAILED){
+                data_ = (const char*)ptr;
+                madvise(ptr, size_, MADV_SEQUENTIAL);
+            }
+        }
+        ::close(fd);
+#endif
+        if(size_ > 0 && data_ == NULL){
+            size_ = 0;
+            return false;
+        }
+        return true;
+    }
+
+    void close()
+    {
+        if(data_ != NULL){
+#ifdef _WIN32
+            UnmapViewOfFile(data_);
+#else
+            munmap((void*)data_, size_);
+#endif
+        }
+        data_ = NULL;
+        size_ = 0;
+    }
+
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    const char* data_;
+    size_t size_;
+};
+
+#endif
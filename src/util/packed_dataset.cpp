@@ -0,0 +1,199 @@
+#include "packed_dataset.hpp"
+
+#include <cstring>
+#include <stdexcept>
+
+#include "image_decoder.hpp"
+
+namespace{
+
+    inline uint64_t padded(uint64_t size){
+        return (size + Packed::kAlignment - 1) / Packed::kAlignment * Packed::kAlignment;
+    }
+
+}
+
+PackedDatasetWriter::PackedDatasetWriter(const std::string& filename, size_t num_cameras):
+buffer_(1 << 22),
+offset_(0)
+{
+    file_.rdbuf()->pubsetbuf(buffer_.data(), buffer_.size());
+    file_.open(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+    if(!file_.is_open()){
+        throw std::runtime_error("cannot create " + filename);
+    }
+    Packed::FileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, Packed::kFileMagic, sizeof(header.magic));
+    header.version = Packed::kVersion;
+    header.num_cameras = (uint32_t)num_cameras;
+    file_.write((const char*)&header, sizeof(header));
+    offset_ = sizeof(header);
+}
+
+PackedDatasetWriter::~PackedDatasetWriter(){
+}
+
+void PackedDatasetWriter::append(const Packed::RecordHeader& header, const void* data){
+    static const char zeros[Packed::kAlignment] = {0};
+    Packed::IndexEntry entry;
+    entry.timestamp = header.timestamp;
+    entry.offset = offset_;
+    entry.type = header.type;
+    entry.camera = header.camera;
+    index_.push_back(entry);
+
+    file_.write((const char*)&header, sizeof(header));
+    file_.write((const char*)data, header.size);
+    file_.write(zeros, padded(header.size) - header.size);
+    offset_ += sizeof(header) + padded(header.size);
+    if(!file_.good()){
+        throw std::runtime_error("writing packed dataset failed");
+    }
+}
+
+void PackedDatasetWriter::add_imu(const ImuSample* samples, size_t count){
+    if(count == 0)
+        return;
+    Packed::RecordHeader header;
+    memset(&header, 0, sizeof(header));
+    header.type = Packed::kImu;
+    header.timestamp = samples[0].timestamp;
+    header.size = count * sizeof(ImuSample);
+    append(header, samples);
+}
+
+void PackedDatasetWriter::add_frame(size_t cam, int64_t timestamp, Packed::Encoding encoding,
+                                    int rows, int cols, const void* data, size_t size){
+    Packed::RecordHeader header;
+    memset(&header, 0, sizeof(header));
+    header.type = Packed::kFrame;
+    header.camera = (uint32_t)cam;
+    header.timestamp = timestamp;
+    header.size = size;
+    header.rows = rows;
+    header.cols = cols;
+    header.encoding = encoding;
+    append(header, data);
+}
+
+void PackedDatasetWriter::close(){
+    if(!file_.is_open())
+        return;
+    Packed::RecordHeader header;
+    memset(&header, 0, sizeof(header));
+    header.type = Packed::kIndex;
+    header.size = index_.size() * sizeof(Packed::IndexEntry);
+    const uint64_t index_offset = offset_;
+    file_.write((const char*)&header, sizeof(header));
+    file_.write((const char*)index_.data(), header.size);
+
+    Packed::Footer footer;
+    footer.index_offset = index_offset;
+    memcpy(footer.magic, Packed::kFooterMagic, sizeof(footer.magic));
+    file_.write((const char*)&footer, sizeof(footer));
+    file_.close();
+    if(file_.fail()){
+        throw std::runtime_error("writing packed dataset failed");
+    }
+}
+
+PackedDataset::PackedDataset(const std::string& filename):
+imu_(NULL),
+imu_size_(0)
+{
+    if(!file_.open(filename) || file_.size() < sizeof(Packed::FileHeader)){
+        throw std::runtime_error("cannot read " + filename);
+    }
+    const char* begin = file_.data();
+    const Packed::FileHeader* file_header = (const Packed::FileHeader*)begin;
+    if(memcmp(file_header->magic, Packed::kFileMagic, sizeof(file_header->magic)) != 0 ||
+       file_header->version != Packed::kVersion){
+        throw std::runtime_error(filename + " is not a packed dataset");
+    }
+    frames_.resize(file_header->num_cameras);
+
+    bool indexed = false;
+    const uint64_t file_size = file_.size();
+    if(file_size >= sizeof(Packed::FileHeader) + sizeof(Packed::RecordHeader) + sizeof(Packed::Footer)){
+        const uint64_t footer_offset = file_size - sizeof(Packed::Footer);
+        const Packed::Footer* footer = (const Packed::Footer*)(begin + footer_offset);
+        const uint64_t index_offset = footer->index_offset;
+        if(memcmp(footer->magic, Packed::kFooterMagic, sizeof(footer->magic)) == 0 &&
+           index_offset >= sizeof(Packed::FileHeader) && index_offset % Packed::kAlignment == 0 &&
+           index_offset <= footer_offset - sizeof(Packed::RecordHeader)){
+            const Packed::RecordHeader* header = (const Packed::RecordHeader*)(begin + index_offset);
+            const uint64_t index_begin = index_offset + sizeof(Packed::RecordHeader);
+            const uint64_t count = header->size / sizeof(Packed::IndexEntry);
+            const Packed::IndexEntry* index = (const Packed::IndexEntry*)(header + 1);
+            // the entries end before the footer and every record before the index
+            if(header->type == Packed::kIndex && count <= (footer_offset - index_begin) / sizeof(Packed::IndexEntry)){
+                indexed = true;
+                for(uint64_t i = 0; indexed && i < count; i++){
+                    indexed = add_record(begin, index[i].offset, index_offset) &&
+                              ((const Packed::RecordHeader*)(begin + index[i].offset))->type == index[i].type;
+                }
+            }
+        }
+    }
+    if(!indexed){
+        // no usable index, walk the records up to the last complete one
+        for(auto& frames : frames_)
+            frames.clear();
+        imu_records_.clear();
+        uint64_t offset = sizeof(Packed::FileHeader);
+        while(file_size - offset >= sizeof(Packed::RecordHeader)){
+            const Packed::RecordHeader* header = (const Packed::RecordHeader*)(begin + offset);
+            if(header->type == Packed::kIndex || !add_record(begin, offset, file_size))
+                break;
+            offset += sizeof(Packed::RecordHeader) + padded(header->size);
+        }
+    }
+
+    if(imu_records_.size() == 1){
+        imu_ = (const ImuSample*)(imu_records_[0] + 1);
+        imu_size_ = imu_records_[0]->size / sizeof(ImuSample);
+    }else{
+        for(const auto header : imu_records_){
+            const ImuSample* samples = (const ImuSample*)(header + 1);
+            imu_copy_.insert(imu_copy_.end(), samples, samples + header->size / sizeof(ImuSample));
+        }
+        imu_ = imu_copy_.data();
+        imu_size_ = imu_copy_.size();
+    }
+    if(imu_size_ == 0){
+        throw std::runtime_error("no imu messages present in " + filename);
+    }
+}
+
+bool PackedDataset::add_record(const char* begin, uint64_t offset, uint64_t limit){
+    if(offset < sizeof(Packed::FileHeader) || offset % Packed::kAlignment != 0 ||
+       offset > limit || limit - offset < sizeof(Packed::RecordHeader))
+        return false;
+    const Packed::RecordHeader* header = (const Packed::RecordHeader*)(begin + offset);
+    // padded payload, written as a multiple of the alignment
+    const uint64_t available = limit - offset - sizeof(Packed::RecordHeader);
+    if(header->size > available || padded(header->size) > available)
+        return false;
+    if(header->type == Packed::kImu){
+        imu_records_.push_back(header);
+    }else if(header->type == Packed::kFrame && header->camera < frames_.size()){
+        if(header->encoding == Packed::kRaw &&
+           (header->rows < 0 || header->cols < 0 || uint64_t(header->rows) * uint64_t(header->cols) > header->size))
+            return false;
+        frames_[header->camera].push_back(header);
+    }
+    return true;
+}
+
+cv::Mat PackedDataset::load_image(size_t cam, size_t frame) const{
+    const Packed::RecordHeader* header = frames_[cam][frame];
+    void* data = (void*)(header + 1);
+    if(header->encoding == Packed::kRaw){
+        cv::Mat image(header->rows, header->cols, CV_8UC1, data);
+        for(int r = reduction(cam); r > 1; r /= 2)
+            image = ImageDecoder::bin2x2(image);
+        return image;
+    }
+    return ImageDecoder::decode((const char*)data, header->size, reduction(cam));
+}
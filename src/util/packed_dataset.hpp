@@ -0,0 +1,144 @@
+#ifndef _PACKED_DATASET_HPP_
+#define _PACKED_DATASET_HPP_
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdint>
+
+#include "dataset.hpp"
+#include "mapped_file.hpp"
+
+///
+/// Single file container holding all frames and IMU samples of a sequence.
+///
+/// Layout: a file header followed by records which are only ever appended.
+/// Every record starts with a PackedRecordHeader and its payload is padded to
+/// kPackedAlignment, so raw frames can be used in place from the memory mapping.
+/// Closing the writer appends an index record with the timestamp and offset of
+/// every record and a footer pointing to it. Files without footer (interrupted
+/// conversion) are still readable by walking the records.
+///
+namespace Packed{
+
+    const char kFileMagic[8] = {'O','K','V','I','S','P','K','1'};
+    const char kFooterMagic[8] = {'O','K','V','I','S','I','D','X'};
+    const uint32_t kVersion = 1;
+    const size_t kAlignment = 64;
+
+    enum RecordType : uint32_t{
+        kImu = 1,
+        kFrame = 2,
+        kIndex = 3
+    };
+
+    enum Encoding : uint32_t{
+        kRaw = 0,       ///< 8 bit grayscale pixels, rows*cols bytes
+        kCompressed = 1 ///< any format cv::imdecode understands (the original png)
+    };
+
+    struct FileHeader{
+        char magic[8];
+        uint32_t version;
+        uint32_t num_cameras;
+        uint64_t reserved[6];
+    };
+
+    struct RecordHeader{
+        uint32_t type;
+        uint32_t camera;
+        int64_t timestamp;
+        uint64_t size;       ///< payload size in bytes, without padding
+        int32_t rows;
+        int32_t cols;
+        uint32_t encoding;
+        uint32_t reserved[7];
+    };
+
+    struct IndexEntry{
+        int64_t timestamp;
+        uint64_t offset;     ///< of the RecordHeader from the file start
+        uint32_t type;
+        uint32_t camera;
+    };
+
+    struct Footer{
+        uint64_t index_offset;
+        char magic[8];
+    };
+
+    static_assert(sizeof(FileHeader) % kAlignment == 0, "file header must keep alignment");
+    static_assert(sizeof(RecordHeader) % kAlignment == 0, "record header must keep alignment");
+    static_assert(sizeof(ImuSample) == 7 * 8, "imu samples are stored as they are in memory");
+
+}
+
+///
+/// Appends records to a packed dataset file.
+/// Records should be added in time order so playback reads the file sequentially.
+///
+class PackedDatasetWriter
+{
+public:
+    /// Throws std::runtime_error if the file cannot be created
+    PackedDatasetWriter(const std::string& filename, size_t num_cameras);
+
+    ~PackedDatasetWriter();
+
+    void add_imu(const ImuSample* samples, size_t count);
+
+    void add_frame(size_t cam, int64_t timestamp, Packed::Encoding encoding,
+                   int rows, int cols, const void* data, size_t size);
+
+    ///
+    /// Writes index and footer. Throws std::runtime_error if writing fails.
+    /// Without close() the file is left unindexed like an interrupted
+    /// conversion, so a failed conversion never looks complete.
+    ///
+    void close();
+
+private:
+    void append(const Packed::RecordHeader& header, const void* data);
+
+    std::ofstream file_;
+    std::vector<char> buffer_;
+    uint64_t offset_;
+    std::vector<Packed::IndexEntry> index_;
+};
+
+///
+/// Memory mapped reader of a packed dataset file.
+/// Raw frames are returned as cv::Mat headers pointing into the mapping,
+/// so the reader has to outlive every image it handed out.
+///
+class PackedDataset : public Dataset
+{
+public:
+    /// Throws std::runtime_error if the file is not a valid packed dataset
+    PackedDataset(const std::string& filename);
+
+    size_t num_cameras() const { return frames_.size(); }
+
+    size_t num_frames(size_t cam) const { return frames_[cam].size(); }
+
+    int64_t frame_timestamp(size_t cam, size_t frame) const { return frames_[cam][frame]->timestamp; }
+
+    cv::Mat load_image(size_t cam, size_t frame) const;
+
+    const ImuSample* imu_data() const { return imu_; }
+
+    size_t imu_size() const { return imu_size_; }
+
+private:
+    /// Returns false unless the record lies within [begin, limit) and fits its type
+    bool add_record(const char* begin, uint64_t offset, uint64_t limit);
+
+    MappedFile file_;
+    std::vector<std::vector<const Packed::RecordHeader*> > frames_;
+    std::vector<const Packed::RecordHeader*> imu_records_;
+    std::vector<ImuSample> imu_copy_;
+    const ImuSample* imu_;
+    size_t imu_size_;
+};
+
+#endif
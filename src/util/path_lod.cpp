@@ -0,0 +1,147 @@
+#include "path_lod.hpp"
+
+#include <cmath>
+#include <utility>
+#include <algorithm>
+
+PathLod::PathLod(double base_error, size_t chunk, size_t num_levels, size_t max_points):
+levels_(num_levels < 1 ? 1 : num_levels),
+chunk_(chunk < 3 ? 3 : chunk),
+max_points_(max_points),
+size_(0)
+{
+    double epsilon = base_error;
+    for(size_t i = 0; i < levels_.size(); ++i){
+        levels_[i].epsilon = epsilon;
+        levels_[i].coarsened = 0.0;
+        levels_[i].dropped = false;
+        epsilon *= 2.0;
+    }
+}
+
+void PathLod::add(const Point& point){
+    push(0, point);
+    ++size_;
+}
+
+double PathLod::error(size_t level) const{
+    // the errors of all finer levels add up
+    double error = 0.0;
+    for(size_t i = 0; i <= level && i < levels_.size(); ++i)
+        error += levels_[i].epsilon + levels_[i].coarsened;
+    return error;
+}
+
+void PathLod::push(size_t level, const Point& point){
+    Level& l = levels_[level];
+    if(l.pending.empty()){
+        // the first point is always kept
+        l.committed.push_back(point);
+        l.pending.push_back(point);
+        if(level + 1 < levels_.size())
+            push(level + 1, point);
+        return;
+    }
+    l.pending.push_back(point);
+    if(l.pending.size() < chunk_)
+        return;
+
+    std::vector<bool> keep;
+    simplify(l.pending, l.epsilon, keep);
+    for(size_t i = 1; i < l.pending.size(); ++i){
+        if(!keep[i])
+            continue;
+        if(!l.dropped)
+            l.committed.push_back(l.pending[i]);
+        if(level + 1 < levels_.size())
+            push(level + 1, l.pending[i]);
+    }
+    if(!l.dropped && l.committed.size() > max_points_){
+        if(level + 1 < levels_.size()){
+            std::vector<Point>().swap(l.committed);
+            l.dropped = true;
+        } else{
+            coarsen(l);
+        }
+    }
+    const Point last = l.pending.back();
+    l.pending.clear();
+    l.pending.push_back(last);
+}
+
+void PathLod::coarsen(Level& level){
+    // the smallest doubling of the level error that halves the points,
+    // simplifying again adds it to the deviation
+    double epsilon = level.epsilon;
+    std::vector<bool> keep;
+    std::vector<Point> points;
+    do{
+        epsilon *= 2.0;
+        simplify(level.committed, epsilon, keep);
+        points.clear();
+        for(size_t i = 0; i < level.committed.size(); ++i){
+            if(keep[i])
+                points.push_back(level.committed[i]);
+        }
+    } while(points.size() > max_points_ / 2 && points.size() > 2);
+    level.committed.swap(points);
+    level.coarsened += epsilon;
+}
+
+void PathLod::polyline(double max_error, std::vector<Point>& points) const{
+    points.clear();
+    if(size_ == 0)
+        return;
+    size_t level = 0;
+    while(level + 1 < levels_.size() && (error(level + 1) <= max_error || levels_[level].dropped))
+        ++level;
+    // committed points of the level, followed by what the finer levels have not passed on yet
+    points = levels_[level].committed;
+    for(size_t i = level + 1; i-- > 0;){
+        const std::vector<Point>& pending = levels_[i].pending;
+        for(size_t j = 1; j < pending.size(); ++j)
+            points.push_back(pending[j]);
+    }
+}
+
+void PathLod::simplify(const std::vector<Point>& points, double epsilon, std::vector<bool>& keep){
+    keep.assign(points.size(), false);
+    keep.front() = true;
+    keep.back() = true;
+    const double epsilon2 = epsilon * epsilon;
+    std::vector<std::pair<size_t, size_t> > stack;
+    stack.push_back(std::make_pair(size_t(0), points.size() - 1));
+    while(!stack.empty()){
+        const size_t begin = stack.back().first;
+        const size_t end = stack.back().second;
+        stack.pop_back();
+        const double dx = points[end].x - points[begin].x;
+        const double dy = points[end].y - points[begin].y;
+        const double length2 = dx * dx + dy * dy;
+        double max_distance2 = 0.0;
+        size_t farthest = begin;
+        for(size_t i = begin + 1; i < end; ++i){
+            const double px = points[i].x - points[begin].x;
+            const double py = points[i].y - points[begin].y;
+            double distance2;
+            if(length2 <= 0.0){
+                distance2 = px * px + py * py;
+            } else{
+                // distance to the segment, not the line, so backtracking is kept
+                const double t = std::max(0.0, std::min(1.0, (px * dx + py * dy) / length2));
+                const double ex = px - t * dx;
+                const double ey = py - t * dy;
+                distance2 = ex * ex + ey * ey;
+            }
+            if(distance2 > max_distance2){
+                max_distance2 = distance2;
+                farthest = i;
+            }
+        }
+        if(max_distance2 > epsilon2){
+            keep[farthest] = true;
+            stack.push_back(std::make_pair(begin, farthest));
+            stack.push_back(std::make_pair(farthest, end));
+        }
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef _PATH_LOD_HPP_
+#define _PATH_LOD_HPP_
+
+#include <vector>
+#include <cstddef>
+
+///
+/// Level of detail representation of a growing path. Level 0 is the path
+/// simplified with Douglas-Peucker at the base error, every further level
+/// simplifies the output of the previous one at twice its error. Points are
+/// simplified in chunks as they arrive, so adding a point costs amortized
+/// constant time and the path never has to be reprocessed as a whole.
+/// The error is measured in the x-y plane, z is carried along.
+/// Memory stays bounded: a level which grows beyond max_points is dropped
+/// and the next coarser one serves its requests instead. The coarsest
+/// level is always kept, it is simplified again at a larger error whenever
+/// it grows beyond max_points.
+///
+class PathLod
+{
+public:
+    struct Point{
+        double x, y, z;
+    };
+
+    /// base_error in the units of the points, chunk is the number of points simplified at once
+    PathLod(double base_error = 0.001, size_t chunk = 64, size_t num_levels = 16,
+            size_t max_points = 1 << 18);
+
+    void add(const Point& point);
+
+    /// Number of points added
+    size_t size() const { return size_; }
+
+    /// Deviation bound of the path at the given level from the input
+    double error(size_t level) const;
+
+    ///
+    /// Writes the coarsest version of the full path whose deviation from the
+    /// input is at most max_error, or the finest one kept if none is that exact
+    ///
+    void polyline(double max_error, std::vector<Point>& points) const;
+
+private:
+    struct Level{
+        double epsilon;
+        double coarsened;              ///< deviation added by simplifying the committed points again
+        std::vector<Point> committed;  ///< simplified, starts at the first point
+        std::vector<Point> pending;    ///< not yet simplified, starts at the last committed point
+        bool dropped;                  ///< committed points were discarded to bound memory
+    };
+
+    void push(size_t level, const Point& point);
+
+    /// Simplifies the committed points of the coarsest level down to half of max_points
+    void coarsen(Level& level);
+
+    /// Douglas-Peucker, marks the points to keep
+    static void simplify(const std::vector<Point>& points, double epsilon, std::vector<bool>& keep);
+
+    std::vector<Level> levels_;
+    size_t chunk_;
+    size_t max_points_;
+    size_t size_;
+};
+
+#endif
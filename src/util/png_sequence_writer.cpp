@@ -0,0 +1,114 @@
+#include "png_sequence_writer.hpp"
+
+#include <stdexcept>
+#include <cstdio>
+#include <algorithm>
+
+#include <boost/filesystem.hpp>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+#if defined(__GNUC__) && __GNUC__ >= 6
+#pragma GCC diagnostic ignored "-Wmisleading-indentation"
+#endif
+#include "../third_party/stb_image_write.h"
+#pragma GCC diagnostic pop
+
+PngSequenceWriter::PngSequenceWriter(const std::string& directory, size_t max_pending):
+directory_(directory),
+max_pending_(std::max<size_t>(max_pending, 1)),
+written_(0),
+dropped_(0),
+failed_(0),
+stop_(false)
+{
+    boost::system::error_code ec;
+    boost::filesystem::create_directories(directory_, ec);
+    if(!boost::filesystem::is_directory(directory_))
+        throw std::runtime_error("cannot create " + directory_);
+    worker_ = std::thread(&PngSequenceWriter::run, this);
+}
+
+PngSequenceWriter::~PngSequenceWriter(){
+    close();
+}
+
+bool PngSequenceWriter::push(int width, int height, int channels, std::vector<unsigned char>&& pixels,
+                             bool bottom_up){
+    if(pixels.size() < size_t(width) * height * channels)
+        return false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(stop_ || pending_.size() >= max_pending_){
+            dropped_++;
+            return false;
+        }
+        Image image;
+        image.width = width;
+        image.height = height;
+        image.channels = channels;
+        image.bottom_up = bottom_up;
+        image.pixels.swap(pixels);
+        pending_.push_back(std::move(image));
+    }
+    wake_.notify_one();
+    return true;
+}
+
+void PngSequenceWriter::close(){
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(stop_)
+            return;
+        stop_ = true;
+    }
+    wake_.notify_one();
+    worker_.join();
+    if(dropped_ > 0 || failed_ > 0)
+        fprintf(stderr, "%s: %llu frames dropped, %llu failed to write\n", directory_.c_str(),
+                (unsigned long long)dropped_, (unsigned long long)failed_);
+}
+
+uint64_t PngSequenceWriter::written() const{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return written_;
+}
+
+uint64_t PngSequenceWriter::dropped() const{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return dropped_;
+}
+
+uint64_t PngSequenceWriter::failed() const{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return failed_;
+}
+
+void PngSequenceWriter::run(){
+    std::unique_lock<std::mutex> lock(mutex_);
+    while(true){
+        wake_.wait(lock, [this]{ return stop_ || !pending_.empty(); });
+        if(pending_.empty())
+            break;
+        Image image = std::move(pending_.front());
+        pending_.pop_front();
+        const uint64_t index = written_;
+        lock.unlock();
+
+        char name[32];
+        snprintf(name, sizeof(name), "frame_%06llu.png", (unsigned long long)index);
+        const std::string filename = (boost::filesystem::path(directory_) / name).string();
+        const int stride = image.width * image.channels;
+        // bottom-up rows are written from the last one with a negative stride
+        const unsigned char* first = image.bottom_up ?
+            image.pixels.data() + size_t(image.height - 1) * stride : image.pixels.data();
+        const bool ok = stbi_write_png(filename.c_str(), image.width, image.height, image.channels,
+                                       first, image.bottom_up ? -stride : stride) != 0;
+
+        lock.lock();
+        written_++;
+        if(!ok)
+            failed_++;
+    }
+}
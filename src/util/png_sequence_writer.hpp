@@ -0,0 +1,70 @@
+#ifndef _PNG_SEQUENCE_WRITER_HPP_
+#define _PNG_SEQUENCE_WRITER_HPP_
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+///
+/// Writes images as a numbered PNG sequence (frame_000000.png, ...) with
+/// the vendored stb_image_write. Compression runs on a background thread,
+/// push() only moves the pixels into a short queue. Images pushed while the
+/// queue is full are dropped and counted, so a slow disk never holds up
+/// the caller.
+///
+class PngSequenceWriter
+{
+public:
+    /// Throws std::runtime_error if the directory cannot be created
+    explicit PngSequenceWriter(const std::string& directory, size_t max_pending = 8);
+
+    ~PngSequenceWriter();
+
+    PngSequenceWriter(const PngSequenceWriter&) = delete;
+    PngSequenceWriter& operator=(const PngSequenceWriter&) = delete;
+
+    ///
+    /// Tightly packed 8 bit pixels with 1, 3 or 4 channels. Rows bottom-up
+    /// as read back from GL if bottom_up is set. Returns false if dropped.
+    ///
+    bool push(int width, int height, int channels, std::vector<unsigned char>&& pixels,
+              bool bottom_up = false);
+
+    /// Writes the queued images and stops the thread
+    void close();
+
+    /// Images written, including those that failed to write
+    uint64_t written() const;
+
+    uint64_t dropped() const;
+
+    uint64_t failed() const;
+
+private:
+    struct Image{
+        int width;
+        int height;
+        int channels;
+        bool bottom_up;
+        std::vector<unsigned char> pixels;
+    };
+
+    void run();
+
+    std::string directory_;
+    size_t max_pending_;
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    std::deque<Image> pending_;
+    uint64_t written_;
+    uint64_t dropped_;
+    uint64_t failed_;
+    bool stop_;
+    std::thread worker_;
+};
+
+#endif
@@ -0,0 +1,165 @@
+#include "point_octree.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace{
+
+    /// Points farther out are taken for failed estimates
+    const float kMaxCoordinate = 1e6f;
+
+    inline int octant(const Eigen::Vector3f& center, const Eigen::Vector3f& point){
+        return (point.x() >= center.x()) | (point.y() >= center.y()) << 1 | (point.z() >= center.z()) << 2;
+    }
+
+}
+
+PointOctree::PointOctree(size_t leaf_capacity, float min_half_size, float initial_half_size):
+leaf_capacity_(std::max<size_t>(leaf_capacity, 1)),
+min_half_size_(min_half_size),
+initial_half_size_(initial_half_size),
+root_(-1)
+{
+}
+
+bool PointOctree::update(uint64_t id, const Eigen::Vector3f& point){
+    if(!point.allFinite() || point.cwiseAbs().maxCoeff() > kMaxCoordinate)
+        return false;
+    cover(point);
+    const auto found = locations_.find(id);
+    if(found != locations_.end()){
+        const Location location = found->second;
+        Node& node = nodes_[location.node];
+        if(contains(node, point)){
+            // still in the same leaf, overwritten in place
+            float* p = &node.points[3 * location.index];
+            p[0] = point.x();
+            p[1] = point.y();
+            p[2] = point.z();
+            mark_dirty(node, location.index, location.index + 1);
+            return true;
+        }
+        remove(id, location);
+    }
+    insert(id, point);
+    return true;
+}
+
+void PointOctree::clear_dirty(int node){
+    nodes_[node].dirty_begin = nodes_[node].dirty_end = 0;
+}
+
+int PointOctree::new_node(const Eigen::Vector3f& center, float half_size){
+    Node node;
+    node.center = center;
+    node.half_size = half_size;
+    std::fill(node.children, node.children + 8, -1);
+    node.dirty_begin = node.dirty_end = 0;
+    nodes_.push_back(std::move(node));
+    return int(nodes_.size()) - 1;
+}
+
+bool PointOctree::contains(const Node& node, const Eigen::Vector3f& point) const{
+    return ((point - node.center).cwiseAbs().array() <= node.half_size).all();
+}
+
+void PointOctree::cover(const Eigen::Vector3f& point){
+    if(root_ < 0){
+        root_ = new_node(point, initial_half_size_);
+        return;
+    }
+    while(!contains(nodes_[root_], point)){
+        // doubled towards the point, the old root becomes one octant
+        const Eigen::Vector3f old_center = nodes_[root_].center;
+        const float half_size = nodes_[root_].half_size;
+        Eigen::Vector3f center;
+        for(int i = 0; i < 3; ++i)
+            center[i] = old_center[i] + (point[i] < old_center[i] ? -half_size : half_size);
+        const int old_root = root_;
+        const int old_octant = octant(center, old_center);
+        root_ = new_node(center, 2.0f * half_size);
+        for(int k = 0; k < 8; ++k){
+            int child = old_root;
+            if(k != old_octant){
+                const Eigen::Vector3f offset(k & 1 ? half_size : -half_size,
+                                             k & 2 ? half_size : -half_size,
+                                             k & 4 ? half_size : -half_size);
+                child = new_node(center + offset, half_size);
+            }
+            nodes_[root_].children[k] = child;
+        }
+    }
+}
+
+void PointOctree::insert(uint64_t id, const Eigen::Vector3f& point){
+    int index = root_;
+    while(!nodes_[index].leaf())
+        index = nodes_[index].children[octant(nodes_[index].center, point)];
+    Node& node = nodes_[index];
+    const size_t slot = node.ids.size();
+    node.points.push_back(point.x());
+    node.points.push_back(point.y());
+    node.points.push_back(point.z());
+    node.ids.push_back(id);
+    mark_dirty(node, slot, slot + 1);
+    Location location = { index, uint32_t(slot) };
+    locations_[id] = location;
+    if(node.ids.size() > leaf_capacity_ && node.half_size > min_half_size_)
+        split(index);
+}
+
+void PointOctree::remove(uint64_t id, const Location& location){
+    Node& node = nodes_[location.node];
+    const size_t last = node.ids.size() - 1;
+    if(location.index != last){
+        // the last point fills the gap
+        std::copy(&node.points[3 * last], &node.points[3 * last] + 3, &node.points[3 * location.index]);
+        node.ids[location.index] = node.ids[last];
+        locations_[node.ids[last]].index = location.index;
+        mark_dirty(node, location.index, location.index + 1);
+    }
+    node.points.resize(3 * last);
+    node.ids.pop_back();
+    locations_.erase(id);
+}
+
+void PointOctree::split(int index){
+    const float half_size = 0.5f * nodes_[index].half_size;
+    for(int k = 0; k < 8; ++k){
+        const Eigen::Vector3f offset(k & 1 ? half_size : -half_size,
+                                     k & 2 ? half_size : -half_size,
+                                     k & 4 ? half_size : -half_size);
+        const int child = new_node(nodes_[index].center + offset, half_size);
+        nodes_[index].children[k] = child;
+    }
+    std::vector<float> points;
+    std::vector<uint64_t> ids;
+    points.swap(nodes_[index].points);
+    ids.swap(nodes_[index].ids);
+    nodes_[index].dirty_begin = nodes_[index].dirty_end = 0;
+    for(size_t i = 0; i < ids.size(); ++i){
+        const Eigen::Vector3f point(points[3 * i], points[3 * i + 1], points[3 * i + 2]);
+        Node& child = nodes_[nodes_[index].children[octant(nodes_[index].center, point)]];
+        child.points.insert(child.points.end(), &points[3 * i], &points[3 * i] + 3);
+        child.ids.push_back(ids[i]);
+        Location location = { int(&child - nodes_.data()), uint32_t(child.ids.size() - 1) };
+        locations_[ids[i]] = location;
+    }
+    for(int k = 0; k < 8; ++k){
+        const int child = nodes_[index].children[k];
+        mark_dirty(nodes_[child], 0, nodes_[child].ids.size());
+        // all points in one octant, split further
+        if(nodes_[child].ids.size() > leaf_capacity_ && nodes_[child].half_size > min_half_size_)
+            split(child);
+    }
+}
+
+void PointOctree::mark_dirty(Node& node, size_t begin, size_t end){
+    if(node.dirty_begin >= node.dirty_end){
+        node.dirty_begin = begin;
+        node.dirty_end = end;
+    } else{
+        node.dirty_begin = std::min(node.dirty_begin, begin);
+        node.dirty_end = std::max(node.dirty_end, end);
+    }
+}
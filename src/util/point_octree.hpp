@@ -0,0 +1,83 @@
+#ifndef _POINT_OCTREE_HPP_
+#define _POINT_OCTREE_HPP_
+
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+
+#include <Eigen/Core>
+
+///
+/// Octree of points keyed by id, e.g. landmarks whose estimates move while
+/// they are refined. Points live in the leaves as packed x, y, z floats.
+/// A leaf holding more than leaf_capacity points is split, unless it is
+/// already as small as min_half_size. The root grows to cover every point
+/// added. Each leaf records the range of its points changed since
+/// clear_dirty(), so copies of the points (e.g. vertex buffers) can be
+/// updated incrementally. Nodes are never removed, their indices stay valid.
+///
+class PointOctree
+{
+public:
+    struct Node{
+        Eigen::Vector3f center;
+        float half_size;
+        int children[8];             ///< -1 for leaves, octant bits x = 1, y = 2, z = 4
+        std::vector<float> points;   ///< x, y, z per point, leaves only
+        std::vector<uint64_t> ids;
+        size_t dirty_begin;          ///< changed points, empty if begin >= end
+        size_t dirty_end;
+
+        bool leaf() const { return children[0] < 0; }
+        size_t size() const { return ids.size(); }
+    };
+
+    PointOctree(size_t leaf_capacity = 4096, float min_half_size = 0.25f, float initial_half_size = 16.0f);
+
+    ///
+    /// Inserts the point or moves it if the id is known. Returns false (and
+    /// ignores the point) if it is not finite or absurdly far out.
+    ///
+    bool update(uint64_t id, const Eigen::Vector3f& point);
+
+    /// Number of points
+    size_t size() const { return locations_.size(); }
+
+    /// -1 while empty
+    int root() const { return root_; }
+
+    const std::vector<Node>& nodes() const { return nodes_; }
+
+    void clear_dirty(int node);
+
+private:
+    struct Location{
+        int node;
+        uint32_t index;
+    };
+
+    int new_node(const Eigen::Vector3f& center, float half_size);
+
+    bool contains(const Node& node, const Eigen::Vector3f& point) const;
+
+    /// Grows the root until it contains the point
+    void cover(const Eigen::Vector3f& point);
+
+    void insert(uint64_t id, const Eigen::Vector3f& point);
+
+    void remove(uint64_t id, const Location& location);
+
+    void split(int node);
+
+    static void mark_dirty(Node& node, size_t begin, size_t end);
+
+    size_t leaf_capacity_;
+    float min_half_size_;
+    float initial_half_size_;
+    int root_;
+    std::vector<Node> nodes_;
+    std::unordered_map<uint64_t, Location> locations_;
+};
+
+#endif
@@ -0,0 +1,111 @@
+#ifndef _REPLAY_CLOCK_HPP_
+#define _REPLAY_CLOCK_HPP_
+
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+
+///
+/// Maps sensor time onto a monotonic wall clock, so recorded data can be
+/// released at the rate a live sensor would deliver it.
+/// A rate of 1 replays in real time, N is N times faster and 0 runs at max speed.
+///
+class ReplayClock
+{
+public:
+    ReplayClock(double rate) :
+    rate_(rate),
+    sensor_start_(0),
+    started_(false)
+    {}
+
+    /// Sensor time sensor_start is released right now
+    void start(int64_t sensor_start){
+        sensor_start_ = sensor_start;
+        wall_start_ = std::chrono::steady_clock::now();
+        started_ = true;
+    }
+
+    ///
+    /// Sleeps until the data with timestamp sensor_time [ns] is due.
+    /// The first call starts the clock.
+    ///
+    void wait_until(int64_t sensor_time){
+        if(!started_)
+            start(sensor_time);
+        if(rate_ <= 0.0)
+            return;
+        std::this_thread::sleep_until(wall_start_ + std::chrono::nanoseconds(
+            int64_t((sensor_time - sensor_start_) / rate_)));
+    }
+
+    /// Sensor time [ns] which is due at the current wall time
+    int64_t sensor_now() const{
+        if(!started_)
+            return 0;
+        if(rate_ <= 0.0)
+            return latest_;
+        const auto elapsed = std::chrono::steady_clock::now() - wall_start_;
+        return sensor_start_ + int64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() * rate_);
+    }
+
+    /// At max speed sensor_now() is the latest released timestamp
+    void released(int64_t sensor_time){
+        latest_ = sensor_time;
+    }
+
+private:
+    double rate_;
+    int64_t sensor_start_;
+    std::atomic<int64_t> latest_{0};
+    std::atomic<bool> started_;
+    std::chrono::steady_clock::time_point wall_start_;
+};
+
+///
+/// Counts frames fed to and states published by a non-blocking estimator.
+/// published() is called from the estimator's callback thread.
+///
+class ReplayMonitor
+{
+public:
+    ReplayMonitor(const ReplayClock& clock) :
+    clock_(clock)
+    {}
+
+    void fed(){
+        fed_++;
+    }
+
+    /// Records the lag of the state at sensor time t behind the replayed sensor time
+    void published(int64_t t){
+        const int64_t lag = clock_.sensor_now() - t;
+        published_++;
+        lag_sum_ += lag;
+        if(lag > lag_max_)
+            lag_max_ = lag;
+    }
+
+    void print_results() const{
+        const size_t fed = fed_;
+        const size_t published = published_;
+        printf("\n--------------------------------------------------------------------\n");
+        printf("Frames fed:        %14zu\n", fed);
+        printf("Frames processed:  %14zu\n", published);
+        printf("Frames dropped:    %14zu\n", fed > published ? fed - published : 0);
+        printf("Mean lag [s]:      %14.3f\n", published ? lag_sum_ * 1e-9 / published : 0.0);
+        printf("Max lag [s]:       %14.3f\n", lag_max_ * 1e-9);
+        printf("--------------------------------------------------------------------\n");
+    }
+
+private:
+    const ReplayClock& clock_;
+    std::atomic<size_t> fed_{0};
+    std::atomic<size_t> published_{0};
+    std::atomic<int64_t> lag_sum_{0};
+    std::atomic<int64_t> lag_max_{0};
+};
+
+#endif
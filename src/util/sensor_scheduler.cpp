@@ -0,0 +1,62 @@
+#include "sensor_scheduler.hpp"
+
+#include <algorithm>
+#include <limits>
+
+const size_t SensorScheduler::kNoFrame = std::numeric_limits<size_t>::max();
+
+SensorScheduler::SensorScheduler(const Dataset& dataset, const std::vector<size_t>& begin,
+                                 const std::vector<size_t>& end, size_t imu_begin, int64_t tolerance):
+dataset_(dataset),
+cursor_(begin),
+end_(end),
+imu_index_(imu_begin),
+tolerance_(tolerance),
+done_(false)
+{
+    for(size_t cam = 0; cam < cursor_.size(); cam++){
+        push_head(cam);
+    }
+}
+
+void SensorScheduler::push_head(size_t cam){
+    if(cursor_[cam] < end_[cam]){
+        Head head;
+        head.timestamp = dataset_.frame_timestamp(cam, cursor_[cam]);
+        head.cam = cam;
+        heads_.push(head);
+    }
+}
+
+bool SensorScheduler::next(Multiframe& multiframe){
+    if(done_ || heads_.empty())
+        return false;
+
+    // group the earliest frame with the heads of the other cameras within tolerance
+    multiframe.frames.assign(cursor_.size(), kNoFrame);
+    const int64_t first = heads_.top().timestamp;
+    multiframe.timestamp = first;
+    std::vector<size_t> grouped;
+    while(!heads_.empty() && heads_.top().timestamp - first <= tolerance_){
+        const Head head = heads_.top();
+        heads_.pop();
+        multiframe.frames[head.cam] = cursor_[head.cam]++;
+        multiframe.timestamp = std::max(multiframe.timestamp, head.timestamp);
+        grouped.push_back(head.cam);
+    }
+    for(const size_t cam : grouped){
+        push_head(cam);
+    }
+
+    // IMU samples up to the first one past the multiframe
+    const ImuSample* imu = dataset_.imu_data();
+    const size_t imu_size = dataset_.imu_size();
+    do{
+        if(imu_index_ >= imu_size){
+            done_ = true;
+            break;
+        }
+    }while(imu[imu_index_++].timestamp <= multiframe.timestamp);
+    multiframe.imu_end = imu_index_;
+    return true;
+}
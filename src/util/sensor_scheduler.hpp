@@ -0,0 +1,69 @@
+#ifndef _SENSOR_SCHEDULER_HPP_
+#define _SENSOR_SCHEDULER_HPP_
+
+#include <vector>
+#include <queue>
+#include <functional>
+#include <cstdint>
+
+#include "dataset.hpp"
+
+///
+/// Frames of several cameras which belong together, and the IMU samples
+/// which have to be fed before them
+///
+struct Multiframe{
+    int64_t timestamp;           ///< of the latest frame in the group [ns]
+    size_t imu_end;              ///< IMU samples up to (excluding) this index precede the frames
+    std::vector<size_t> frames;  ///< frame index per camera, kNoFrame if the camera has none
+};
+
+///
+/// Merges the frame streams of any number of cameras and the IMU stream of a
+/// dataset in global time order (k-way merge over the camera heads).
+/// Frames of different cameras within the timestamp tolerance are grouped
+/// into one multiframe, so unsynchronized or different rate cameras are fed
+/// correctly. Every multiframe is preceded by all IMU samples up to and
+/// including the first one after its timestamp, as the estimator needs them
+/// to process the frames.
+///
+class SensorScheduler
+{
+public:
+    static const size_t kNoFrame;
+
+    ///
+    /// Schedules the frames [begin[c], end[c]) of every camera c and the IMU
+    /// samples from imu_begin on. tolerance is in [ns].
+    ///
+    SensorScheduler(const Dataset& dataset, const std::vector<size_t>& begin,
+                    const std::vector<size_t>& end, size_t imu_begin, int64_t tolerance);
+
+    ///
+    /// Produces the next multiframe. Returns false once all frames are scheduled
+    /// or the IMU samples ran out.
+    ///
+    bool next(Multiframe& multiframe);
+
+private:
+    struct Head{
+        int64_t timestamp;
+        size_t cam;
+        bool operator>(const Head& other) const{
+            return timestamp > other.timestamp ||
+                   (timestamp == other.timestamp && cam > other.cam);
+        }
+    };
+
+    void push_head(size_t cam);
+
+    const Dataset& dataset_;
+    std::vector<size_t> cursor_;
+    std::vector<size_t> end_;
+    size_t imu_index_;
+    int64_t tolerance_;
+    bool done_;
+    std::priority_queue<Head, std::vector<Head>, std::greater<Head> > heads_;
+};
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef _SNAPSHOT_QUEUE_HPP_
+#define _SNAPSHOT_QUEUE_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+///
+/// Lock-free single producer, single consumer ring of snapshots.
+/// The producer never blocks or allocates: push copies one element and
+/// publishes it with a release store, so it can be called from threads
+/// that must not be stalled by the consumer. When the consumer falls more
+/// than Capacity elements behind, new snapshots are dropped and counted.
+///
+template<class T, size_t Capacity>
+class SnapshotQueue
+{
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    SnapshotQueue() : head_(0), tail_(0), dropped_(0) {}
+
+    SnapshotQueue(const SnapshotQueue&) = delete;
+    SnapshotQueue& operator=(const SnapshotQueue&) = delete;
+
+    /// Producer side, returns false if the snapshot was dropped
+    bool push(const T& value){
+        const uint64_t head = head_.load(std::memory_order_relaxed);
+        if(head - tail_.load(std::memory_order_acquire) == Capacity){
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        slots_[head & (Capacity - 1)] = value;
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// Consumer side, returns false if there is nothing new
+    bool pop(T& value){
+        const uint64_t tail = tail_.load(std::memory_order_relaxed);
+        if(tail == head_.load(std::memory_order_acquire))
+            return false;
+        value = slots_[tail & (Capacity - 1)];
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// Snapshots waiting, exact only on the consumer side while nothing is pushed
+    size_t size() const{
+        const uint64_t tail = tail_.load(std::memory_order_relaxed);
+        return size_t(head_.load(std::memory_order_acquire) - tail);
+    }
+
+    /// Number of snapshots the producer had to drop so far
+    uint64_t dropped() const{
+        return dropped_.load(std::memory_order_relaxed);
+    }
+
+private:
+    T slots_[Capacity];
+    // producer and consumer indices live on separate cache lines
+    char pad0_[64];
+    std::atomic<uint64_t> head_;
+    char pad1_[64];
+    std::atomic<uint64_t> tail_;
+    std::atomic<uint64_t> dropped_;
+};
+
+#endif
@@ -0,0 +1,247 @@
+#include "state_history.hpp"
+
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <cerrno>
+
+#ifndef _WIN32
+	#include <sys/mman.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+namespace{
+
+    /// Chunks mapped at once from the spill file
+    const size_t kChunksPerSegment = 16;
+
+    /// Segments kept mapped for reading
+    const size_t kMappedSegments = 4;
+
+}
+
+StateHistory::StateHistory(size_t memory_limit, const std::string& spill_filename, size_t chunk_size):
+chunk_size_((std::max<size_t>(chunk_size, 1) + 63) / 64 * 64),  // keeps segments page aligned
+chunk_bytes_((1 + kNumColumns) * sizeof(double) * chunk_size_),
+max_resident_(std::max<size_t>(2, memory_limit / chunk_bytes_)),
+size_(0),
+first_chunk_(0),
+first_resident_(0),
+fd_(-1),
+spilling_(false),
+segment_uses_(0),
+cold_index_(size_t(-1))
+{
+    static_assert(sizeof(int64_t) == sizeof(double), "timestamps are stored as one more column");
+#ifndef _WIN32
+    if(spill_filename.empty()){
+        // removed right away, it only lives as long as the descriptor
+        const char* tmp = getenv("TMPDIR");
+        std::string pattern = std::string(tmp ? tmp : "/tmp") + "/okvis_history_XXXXXX";
+        std::vector<char> name(pattern.begin(), pattern.end());
+        name.push_back('\0');
+        fd_ = mkstemp(name.data());
+        if(fd_ >= 0)
+            unlink(name.data());
+    } else{
+        fd_ = ::open(spill_filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    }
+    if(fd_ < 0)
+        throw std::runtime_error("cannot create the state history file " + spill_filename);
+    spilling_ = true;
+#else
+    (void)spill_filename;
+#endif
+}
+
+StateHistory::~StateHistory(){
+#ifndef _WIN32
+    for(const auto& segment : segments_)
+        munmap(segment.data, kChunksPerSegment * chunk_bytes_);
+    if(fd_ >= 0)
+        ::close(fd_);
+#endif
+}
+
+bool StateHistory::append(const StateRecord& state){
+    if(size_ > first() && state.timestamp <= timestamp(size_ - 1))
+        return false;
+    const size_t offset = size_ % chunk_size_;
+    if(offset == 0){
+        if(resident_.size() == max_resident_)
+            spill();
+        resident_.push_back(std::unique_ptr<char[]>(new char[chunk_bytes_]));
+    }
+    int64_t* timestamps = reinterpret_cast<int64_t*>(resident_.back().get());
+    double* values = reinterpret_cast<double*>(timestamps + chunk_size_) + offset;
+    timestamps[offset] = state.timestamp;
+    for(size_t i = 0; i < 3; ++i)
+        values[(kPosition + i) * chunk_size_] = state.r[i];
+    for(size_t i = 0; i < 4; ++i)
+        values[(kOrientation + i) * chunk_size_] = state.q[i];
+    for(size_t i = 0; i < 9; ++i)
+        values[(kSpeedAndBiases + i) * chunk_size_] = state.speed_and_biases[i];
+    for(size_t i = 0; i < 3; ++i)
+        values[(kOmega + i) * chunk_size_] = state.omega[i];
+    size_++;
+    return true;
+}
+
+StateHistory::Chunk StateHistory::chunk(size_t index) const{
+    const char* data = index >= first_resident_ ? resident_[index - first_resident_].get() : spilled_chunk(index);
+    Chunk chunk;
+    chunk.timestamps = reinterpret_cast<const int64_t*>(data);
+    chunk.values = reinterpret_cast<const double*>(chunk.timestamps + chunk_size_);
+    return chunk;
+}
+
+int64_t StateHistory::timestamp(size_t index) const{
+    return chunk(index / chunk_size_).timestamps[index % chunk_size_];
+}
+
+StateRecord StateHistory::get(size_t index) const{
+    const Chunk c = chunk(index / chunk_size_);
+    const size_t offset = index % chunk_size_;
+    StateRecord state;
+    state.timestamp = c.timestamps[offset];
+    const double* values = c.values + offset;
+    for(size_t i = 0; i < 3; ++i)
+        state.r[i] = values[(kPosition + i) * chunk_size_];
+    for(size_t i = 0; i < 4; ++i)
+        state.q[i] = values[(kOrientation + i) * chunk_size_];
+    for(size_t i = 0; i < 9; ++i)
+        state.speed_and_biases[i] = values[(kSpeedAndBiases + i) * chunk_size_];
+    for(size_t i = 0; i < 3; ++i)
+        state.omega[i] = values[(kOmega + i) * chunk_size_];
+    return state;
+}
+
+size_t StateHistory::lower_bound(int64_t t) const{
+    if(size_ == first() || t > timestamp(size_ - 1))
+        return size_;
+    // first the chunk by its first timestamp, then within the chunk
+    size_t first = first_chunk_;
+    size_t last = (size_ + chunk_size_ - 1) / chunk_size_;
+    while(last - first > 1){
+        const size_t middle = (first + last) / 2;
+        if(chunk(middle).timestamps[0] <= t)
+            first = middle;
+        else
+            last = middle;
+    }
+    const size_t count = std::min(chunk_size_, size_ - first * chunk_size_);
+    const int64_t* timestamps = chunk(first).timestamps;
+    return first * chunk_size_ + (std::lower_bound(timestamps, timestamps + count, t) - timestamps);
+}
+
+void StateHistory::decimate(int64_t begin, int64_t end, size_t max_states, std::vector<size_t>& indices) const{
+    indices.clear();
+    const size_t first = lower_bound(begin);
+    const size_t last = lower_bound(end);
+    if(first >= last || max_states == 0)
+        return;
+    const size_t count = last - first;
+    const size_t stride = (count + max_states - 1) / max_states;
+    for(size_t i = first; i < last; i += stride)
+        indices.push_back(i);
+    if(indices.back() != last - 1){
+        if(indices.size() == max_states)
+            indices.back() = last - 1;
+        else
+            indices.push_back(last - 1);
+    }
+}
+
+void StateHistory::read(int64_t begin, int64_t end, size_t max_states, std::vector<StateRecord>& states) const{
+    std::vector<size_t> indices;
+    decimate(begin, end, max_states, indices);
+    states.resize(indices.size());
+    for(size_t i = 0; i < indices.size(); ++i)
+        states[i] = get(indices[i]);
+}
+
+void StateHistory::read_positions(int64_t begin, int64_t end, size_t max_states,
+                                  std::vector<Eigen::Vector3d>& positions) const{
+    std::vector<size_t> indices;
+    decimate(begin, end, max_states, indices);
+    positions.resize(indices.size());
+    for(size_t i = 0; i < indices.size(); ++i){
+        const double* values = chunk(indices[i] / chunk_size_).values + indices[i] % chunk_size_;
+        positions[i] = Eigen::Vector3d(values[kPosition * chunk_size_],
+                                       values[(kPosition + 1) * chunk_size_],
+                                       values[(kPosition + 2) * chunk_size_]);
+    }
+}
+
+void StateHistory::spill(){
+    const size_t index = first_resident_;
+#ifndef _WIN32
+    if(spilling_){
+        // written, not mapped, so only the segments being read take address space
+        const size_t bytes = chunk_bytes_;
+        const off_t offset = off_t(index) * bytes;
+        const char* data = resident_.front().get();
+        size_t written = 0;
+        while(written < bytes){
+            const ssize_t n = pwrite(fd_, data + written, bytes - written, offset + written);
+            if(n <= 0)
+                break;
+            written += size_t(n);
+        }
+        if(written < bytes){
+            fprintf(stderr, "cannot write the state history file (%s), dropping old states from now on\n",
+                    strerror(errno));
+            spilling_ = false;
+        }
+    }
+#endif
+    resident_.pop_front();
+    first_resident_++;
+    // without a spill file the history starts after the resident chunks
+    if(!spilling_)
+        first_chunk_ = first_resident_;
+}
+
+const char* StateHistory::spilled_chunk(size_t index) const{
+#ifndef _WIN32
+    const size_t segment = index / kChunksPerSegment;
+    const size_t within = (index % kChunksPerSegment) * chunk_bytes_;
+    for(auto& s : segments_){
+        if(s.index == segment){
+            s.last_use = ++segment_uses_;
+            return s.data + within;
+        }
+    }
+    const size_t segment_bytes = kChunksPerSegment * chunk_bytes_;
+    void* map = mmap(NULL, segment_bytes, PROT_READ, MAP_SHARED, fd_, off_t(segment) * segment_bytes);
+    if(map != MAP_FAILED){
+        Segment s;
+        s.index = segment;
+        s.data = static_cast<char*>(map);
+        s.last_use = ++segment_uses_;
+        if(segments_.size() < kMappedSegments){
+            segments_.push_back(s);
+        } else{
+            auto oldest = std::min_element(segments_.begin(), segments_.end(),
+                [](const Segment& a, const Segment& b) { return a.last_use < b.last_use; });
+            munmap(oldest->data, segment_bytes);
+            *oldest = s;
+        }
+        return s.data + within;
+    }
+    // out of address space, only this chunk is read
+    if(cold_index_ != index){
+        cold_.resize(chunk_bytes_);
+        if(pread(fd_, cold_.data(), chunk_bytes_, off_t(index) * chunk_bytes_) != ssize_t(chunk_bytes_))
+            std::fill(cold_.begin(), cold_.end(), 0);
+        cold_index_ = index;
+    }
+    return cold_.data();
+#else
+    (void)index;
+    return NULL;
+#endif
+}
@@ -0,0 +1,124 @@
+#ifndef _STATE_HISTORY_HPP_
+#define _STATE_HISTORY_HPP_
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <cstdint>
+
+#include <Eigen/Core>
+
+#include "trajectory_writer.hpp"
+
+///
+/// Complete history of estimator states in bounded memory.
+///
+/// States are stored column-wise (struct of arrays) in chunks of a fixed
+/// number of states, so reading e.g. only positions touches only those
+/// columns. The newest chunks are kept on the heap, older ones are written to
+/// a spill file. Reads of old states map the file in segments of several
+/// chunks, of which only the few most recently read stay mapped, so they are
+/// served from the page cache while the process itself holds at most
+/// memory_limit bytes of history and a bounded amount of address space, no
+/// matter how long it runs. Without a spill file name an anonymous temporary
+/// file is used.
+///
+/// Without spilling, on Windows or once writing the spill file failed (e.g.
+/// a full disk, reported on stderr), the oldest chunks are dropped instead:
+/// the memory stays bounded, but first() moves on.
+///
+/// Not thread-safe, append and read from the same thread.
+///
+class StateHistory
+{
+public:
+    /// Throws std::runtime_error if the spill file cannot be created
+    StateHistory(size_t memory_limit, const std::string& spill_filename = std::string(),
+                 size_t chunk_size = 4096);
+
+    ~StateHistory();
+
+    StateHistory(const StateHistory&) = delete;
+    StateHistory& operator=(const StateHistory&) = delete;
+
+    /// Returns false (and ignores the state) unless it is newer than the last one
+    bool append(const StateRecord& state);
+
+    /// Number of states appended
+    size_t size() const { return size_; }
+
+    /// Index of the oldest state kept, states before it were dropped
+    size_t first() const { return first_chunk_ * chunk_size_; }
+
+    /// index has to be within [first(), size())
+    int64_t timestamp(size_t index) const;
+
+    StateRecord get(size_t index) const;
+
+    /// Index of the first kept state at or after timestamp, size() if there is none
+    size_t lower_bound(int64_t timestamp) const;
+
+    ///
+    /// States in [begin, end) [ns], decimated to at most max_states evenly
+    /// spaced ones. The last state of the range is always included.
+    ///
+    void read(int64_t begin, int64_t end, size_t max_states, std::vector<StateRecord>& states) const;
+
+    /// Like read(), but only the positions
+    void read_positions(int64_t begin, int64_t end, size_t max_states,
+                        std::vector<Eigen::Vector3d>& positions) const;
+
+    /// Bytes of history held on the heap
+    size_t memory_usage() const { return resident_.size() * chunk_bytes_; }
+
+    size_t spilled_chunks() const { return first_resident_ - first_chunk_; }
+
+private:
+    /// Columns after the timestamps, as doubles
+    enum Column{
+        kPosition = 0,
+        kOrientation = 3,
+        kSpeedAndBiases = 7,
+        kOmega = 16,
+        kNumColumns = 19
+    };
+
+    struct Chunk{
+        const int64_t* timestamps;
+        const double* values;  ///< kNumColumns columns of chunk_size_ values
+    };
+
+    struct Segment{
+        size_t index;
+        char* data;
+        uint64_t last_use;
+    };
+
+    /// Valid until the next call, maps the chunk's segment if it was spilled
+    Chunk chunk(size_t index) const;
+
+    const char* spilled_chunk(size_t index) const;
+
+    /// Indices of the states to read for a time range
+    void decimate(int64_t begin, int64_t end, size_t max_states, std::vector<size_t>& indices) const;
+
+    /// Moves the oldest resident chunk to the spill file, or drops it
+    void spill();
+
+    size_t chunk_size_;
+    size_t chunk_bytes_;
+    size_t max_resident_;
+    size_t size_;
+    size_t first_chunk_;                            ///< chunks before were dropped
+    std::deque<std::unique_ptr<char[]> > resident_; ///< storage of the chunks from first_resident_ on
+    size_t first_resident_;                         ///< chunks before are in the spill file
+    int fd_;
+    bool spilling_;
+    mutable std::vector<Segment> segments_;         ///< mapped for reading, least recently used replaced
+    mutable uint64_t segment_uses_;
+    mutable std::vector<char> cold_;                ///< a spilled chunk read without mapping
+    mutable size_t cold_index_;
+};
+
+#endif
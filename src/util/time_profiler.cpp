@@ -1,7 +1,183 @@
 #include "time_profiler.hpp"
 
-//These variables need to be defined in the cpp
+#include <mutex>
+#include <memory>
+#include <map>
+#include <algorithm>
+#include <cstdio>
 
-std::vector<std::string> ProfileManager::profilers_;
-std::vector<int> ProfileManager::counts_;
-std::vector<std::chrono::duration<double> > ProfileManager::times_;
\ No newline at end of file
+namespace{
+
+    // buckets of a quarter octave: 0..3 ns exactly, then 4 per power of two
+    const size_t kNumBuckets = 256;
+
+    struct Histogram{
+        // written by the owning thread only, read while merging
+        std::atomic<uint64_t> counts[kNumBuckets];
+        std::atomic<uint64_t> count;
+        std::atomic<uint64_t> sum;
+        std::atomic<uint64_t> max;
+
+        Histogram(): count(0), sum(0), max(0){
+            for(auto& c : counts)
+                c.store(0, std::memory_order_relaxed);
+        }
+    };
+
+    struct ThreadBuffer{
+        std::atomic<Histogram*> histograms[ProfileManager::kMaxProfilers];
+
+        ThreadBuffer(){
+            for(auto& h : histograms)
+                h.store(NULL, std::memory_order_relaxed);
+        }
+
+        ~ThreadBuffer(){
+            for(auto& h : histograms)
+                delete h.load(std::memory_order_relaxed);
+        }
+    };
+
+    // names and thread buffers, only touched while registering and merging
+    struct Registry{
+        std::mutex mutex;
+        std::vector<std::string> names;
+        std::map<std::string, uint32_t> ids;
+        std::vector<std::unique_ptr<ThreadBuffer> > buffers;  ///< kept after their threads end
+    };
+
+    Registry& registry(){
+        static Registry* instance = new Registry();  // never destroyed, threads may outlive main
+        return *instance;
+    }
+
+    ThreadBuffer* thread_buffer(){
+        static thread_local ThreadBuffer* buffer = NULL;
+        if(buffer == NULL){
+            Registry& r = registry();
+            std::lock_guard<std::mutex> lock(r.mutex);
+            r.buffers.push_back(std::unique_ptr<ThreadBuffer>(new ThreadBuffer()));
+            buffer = r.buffers.back().get();
+        }
+        return buffer;
+    }
+
+    inline int highest_bit(uint64_t x){
+        int bit = 0;
+        for(int step = 32; step > 0; step /= 2){
+            if(x >> step){
+                x >>= step;
+                bit += step;
+            }
+        }
+        return bit;
+    }
+
+    inline size_t bucket(uint64_t ns){
+        if(ns < 4)
+            return size_t(ns);
+        const int e = highest_bit(ns);
+        return 4 * (e - 1) + ((ns >> (e - 2)) & 3);
+    }
+
+    /// Middle of the bucket [ns]
+    inline double bucket_value(size_t b){
+        if(b < 4)
+            return double(b);
+        const int e = int(b / 4) + 1;
+        const double lower = double(uint64_t(4 + b % 4) << (e - 2));
+        return lower + 0.5 * double(uint64_t(1) << (e - 2));
+    }
+
+    // single writer, so no read-modify-write is needed
+    inline void add(std::atomic<uint64_t>& value, uint64_t amount){
+        value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+}
+
+uint32_t ProfileManager::intern(const std::string& name){
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    const auto found = r.ids.find(name);
+    if(found != r.ids.end())
+        return found->second;
+    const uint32_t id = uint32_t(r.names.size());
+    if(id >= kMaxProfilers)
+        return kMaxProfilers;
+    r.names.push_back(name);
+    r.ids[name] = id;
+    return id;
+}
+
+void ProfileManager::record(uint32_t id, uint64_t nanoseconds){
+    if(id >= kMaxProfilers)
+        return;
+    ThreadBuffer* buffer = thread_buffer();
+    Histogram* histogram = buffer->histograms[id].load(std::memory_order_relaxed);
+    if(histogram == NULL){
+        histogram = new Histogram();
+        buffer->histograms[id].store(histogram, std::memory_order_release);
+    }
+    add(histogram->counts[bucket(nanoseconds)], 1);
+    add(histogram->count, 1);
+    add(histogram->sum, nanoseconds);
+    if(nanoseconds > histogram->max.load(std::memory_order_relaxed))
+        histogram->max.store(nanoseconds, std::memory_order_relaxed);
+}
+
+std::vector<ProfileManager::Summary> ProfileManager::summaries(){
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    std::vector<Summary> result;
+    std::vector<uint64_t> counts(kNumBuckets);
+    for(uint32_t id = 0; id < r.names.size(); ++id){
+        std::fill(counts.begin(), counts.end(), 0);
+        Summary summary;
+        summary.name = r.names[id];
+        summary.count = 0;
+        uint64_t sum = 0;
+        uint64_t max = 0;
+        for(const auto& buffer : r.buffers){
+            const Histogram* h = buffer->histograms[id].load(std::memory_order_acquire);
+            if(h == NULL)
+                continue;
+            for(size_t b = 0; b < kNumBuckets; ++b)
+                counts[b] += h->counts[b].load(std::memory_order_relaxed);
+            sum += h->sum.load(std::memory_order_relaxed);
+            max = std::max(max, h->max.load(std::memory_order_relaxed));
+        }
+        for(size_t b = 0; b < kNumBuckets; ++b)
+            summary.count += counts[b];
+        if(summary.count == 0)
+            continue;
+        // percentiles at the middle of their bucket, never above the maximum
+        const double quantiles[3] = {0.5, 0.9, 0.99};
+        double* values[3] = {&summary.p50, &summary.p90, &summary.p99};
+        for(int q = 0; q < 3; ++q){
+            const uint64_t rank = std::max<uint64_t>(1, uint64_t(quantiles[q] * summary.count + 0.5));
+            uint64_t seen = 0;
+            size_t b = 0;
+            while(b < kNumBuckets - 1 && seen + counts[b] < rank)
+                seen += counts[b++];
+            *values[q] = std::min(bucket_value(b), double(max)) * 1e-9;
+        }
+        summary.mean = double(sum) / summary.count * 1e-9;
+        summary.max = max * 1e-9;
+        result.push_back(summary);
+    }
+    return result;
+}
+
+void ProfileManager::printResults(){
+    const std::vector<Summary> results = summaries();
+    if(results.empty())
+        return;
+    printf("\n--------------------------------------------------------------------\n");
+    printf("Name:                   Count:   Mean:    p50:     p90:     p99:     Max: [ms]\n");
+    for(const auto& s : results){
+        printf("%-20s%10llu%9.3f%9.3f%9.3f%9.3f%9.3f\n", s.name.c_str(), (unsigned long long)s.count,
+               s.mean * 1e3, s.p50 * 1e3, s.p90 * 1e3, s.p99 * 1e3, s.max * 1e3);
+    }
+    printf("--------------------------------------------------------------------\n");
+}
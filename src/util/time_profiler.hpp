@@ -3,63 +3,86 @@
 
 #include <string>
 #include <vector>
+#include <atomic>
 #include <chrono>
+#include <cstdint>
 
-
+///
+/// Scoped timing of code sections, e.g.
+///
+///     void feed() {
+///         MYPROFILE(feed)
+///         ...
+///     }
+///
+/// Each MYPROFILE site interns its name once, the first time it runs, and
+/// from then on only records into histograms of the calling thread: no
+/// lookups, no locks and no sharing of cache lines between threads. The
+/// histograms of all threads are merged when the results are read.
+/// Durations are measured with steady_clock and kept in buckets of a
+/// quarter octave (about 19% wide) from 1 ns to centuries.
+///
+/// Without ENABLE_PROFILING, MYPROFILE expands to nothing.
+///
 class ProfileManager
 {
 public:
-	static std::vector<std::string> profilers_;
-	static std::vector<int> counts_;
-	static std::vector<std::chrono::duration<double> > times_;
-	static void saveResult(std::string name, std::chrono::duration<double>  time){
-		int index = -1;
-		for(size_t i =0; i< profilers_.size(); i++){
-			if(profilers_[i]==name){
-				index=(int)i;
-			}
-		}
-		if(index==-1){
-			profilers_.push_back(name);
-			counts_.push_back(1);
-			times_.push_back(time);
-		}else{
-			counts_[index]++;
-			times_[index]+=time;
-		}
+    /// Distinct names, later ones are not recorded
+    static const uint32_t kMaxProfilers = 256;
+
+    struct Summary{
+        std::string name;
+        uint64_t count;
+        double mean;  ///< [s]
+        double p50;
+        double p90;
+        double p99;
+        double max;
+    };
+
+    /// Same id for the same name, registration takes a lock
+    static uint32_t intern(const std::string& name);
+
+    /// Lock-free, from any thread
+    static void record(uint32_t id, uint64_t nanoseconds);
+
+    /// Merged over all threads, in the order of registration, without unused names
+    static std::vector<Summary> summaries();
 
-	}
+    static void printResults();
 
-	static void printResults(){
-		printf("\n--------------------------------------------------------------------\n");
-		printf("Name:                        Hz:     Avg Time:        Count:        \n");
-		for(size_t i =0; i< profilers_.size(); i++){
-			printf("%-24s%8.3f%14.3f%14i\n", profilers_[i].c_str(),counts_[i]/(float)times_[i].count(),times_[i].count()/(float)counts_[i],counts_[i]);
-		}
-		printf("\n--------------------------------------------------------------------\n");
-	}
 private:
-	ProfileManager();
-	~ProfileManager();
-	
+    ProfileManager();
+    ~ProfileManager();
 };
 
 class Profiler{
 public:
-	std::chrono::time_point<std::chrono::system_clock> start_;
-	std::string name_;
-	Profiler(std::string name):
-	name_(name),
-	start_(std::chrono::system_clock::now()){
-	}
+    explicit Profiler(uint32_t id):
+    id_(id),
+    start_(std::chrono::steady_clock::now()){
+    }
 
-	~Profiler(){
-		ProfileManager::saveResult(name_,std::chrono::system_clock::now()-start_);
-	}
-};
-
-#define MYPROFILE(x) Profiler profileThis(#x);
+    ~Profiler(){
+        const auto elapsed = std::chrono::steady_clock::now() - start_;
+        ProfileManager::record(id_, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    }
 
+private:
+    uint32_t id_;
+    std::chrono::steady_clock::time_point start_;
+};
 
+#ifdef ENABLE_PROFILING
+    #define PROFILE_CONCAT_(a, b) a##b
+    #define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+    #define PROFILE_SCOPE_(x, n) \
+        static const uint32_t PROFILE_CONCAT(profile_id_, n) = ProfileManager::intern(#x); \
+        Profiler PROFILE_CONCAT(profile_scope_, n)(PROFILE_CONCAT(profile_id_, n));
+    // unique names, so a scope may hold several
+    #define MYPROFILE(x) PROFILE_SCOPE_(x, __COUNTER__)
+#else
+    #define MYPROFILE(x)
+#endif
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,180 @@
+#include "trajectory_evaluator.hpp"
+#include "mapped_file.hpp"
+#include "csv_numbers.hpp"
+
+#include <stdexcept>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+#include <Eigen/SVD>
+
+using namespace CsvNumbers;
+
+const int64_t GroundTruth::kMaxGap;
+
+GroundTruth::GroundTruth(const std::string& filename){
+    MappedFile file;
+    if(!file.open(filename))
+        throw std::runtime_error("cannot read " + filename);
+    const char* p = file.data();
+    const char* end = file.data() + file.size();
+    // ground truth lines have 17 columns of ~15 bytes
+    samples_.reserve(file.size() / 200 + 1);
+    while(p < end){
+        const char* line_end = p;
+        while(line_end < end && *line_end != '\n')
+            line_end++;
+
+        skip_blanks(p, line_end);
+        // header, comment and empty lines
+        if(p < line_end && (is_digit(*p) || *p == '-' || *p == '+')){
+            GroundTruthSample sample;
+            bool ok = parse_int(p, line_end, sample.timestamp);
+            for(int j = 0; ok && j < 3; ++j)
+                ok = expect_separator(p, line_end) && parse_double(p, line_end, sample.r[j]);
+            for(int j = 0; ok && j < 4; ++j)
+                ok = expect_separator(p, line_end) && parse_double(p, line_end, sample.q[j]);
+            if(!ok)
+                throw std::runtime_error("malformed line in " + filename);
+            samples_.push_back(sample);
+        }
+        p = line_end + 1;
+    }
+    if(samples_.empty())
+        throw std::runtime_error("no poses in " + filename);
+}
+
+bool GroundTruth::interpolate(int64_t timestamp, Eigen::Vector3d& r, Eigen::Quaterniond& q) const{
+    const auto after = std::lower_bound(
+        samples_.begin(), samples_.end(), timestamp,
+        [](const GroundTruthSample& s, int64_t t) { return s.timestamp < t; });
+    if(after == samples_.end())
+        return false;
+    if(after->timestamp == timestamp){
+        r = Eigen::Vector3d(after->r[0], after->r[1], after->r[2]);
+        q = Eigen::Quaterniond(after->q[0], after->q[1], after->q[2], after->q[3]).normalized();
+        return true;
+    }
+    if(after == samples_.begin())
+        return false;
+    const GroundTruthSample& a = *(after - 1);
+    const GroundTruthSample& b = *after;
+    if(b.timestamp - a.timestamp > kMaxGap)
+        return false;
+    const double s = double(timestamp - a.timestamp) / double(b.timestamp - a.timestamp);
+    const Eigen::Vector3d ra(a.r[0], a.r[1], a.r[2]);
+    const Eigen::Vector3d rb(b.r[0], b.r[1], b.r[2]);
+    r = ra + s * (rb - ra);
+    const Eigen::Quaterniond qa = Eigen::Quaterniond(a.q[0], a.q[1], a.q[2], a.q[3]).normalized();
+    const Eigen::Quaterniond qb = Eigen::Quaterniond(b.q[0], b.q[1], b.q[2], b.q[3]).normalized();
+    q = qa.slerp(s, qb);
+    return true;
+}
+
+TrajectoryEvaluator::TrajectoryEvaluator(const GroundTruth& ground_truth, int64_t rpe_interval):
+ground_truth_(ground_truth),
+rpe_interval_(rpe_interval),
+count_(0),
+missing_(0),
+mean_estimate_(Eigen::Vector3d::Zero()),
+mean_truth_(Eigen::Vector3d::Zero()),
+cross_(Eigen::Matrix3d::Zero()),
+spread_estimate_(0.0),
+spread_truth_(0.0),
+rpe_count_(0),
+rpe_translation_sum_(0.0),
+rpe_rotation_sum_(0.0)
+{
+}
+
+bool TrajectoryEvaluator::add(int64_t timestamp, const Eigen::Vector3d& r, const Eigen::Quaterniond& q){
+    // the ground truth is immutable, so the lookup happens outside the lock
+    Eigen::Vector3d r_truth;
+    Eigen::Quaterniond q_truth;
+    const bool found = ground_truth_.interpolate(timestamp, r_truth, q_truth);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(!found){
+        missing_++;
+        return false;
+    }
+
+    // Welford updates, stable over long trajectories far from the origin
+    count_++;
+    const Eigen::Vector3d d_estimate = r - mean_estimate_;
+    const Eigen::Vector3d d_truth = r_truth - mean_truth_;
+    mean_estimate_ += d_estimate / double(count_);
+    mean_truth_ += d_truth / double(count_);
+    cross_ += d_estimate * (r_truth - mean_truth_).transpose();
+    spread_estimate_ += d_estimate.dot(r - mean_estimate_);
+    spread_truth_ += d_truth.dot(r_truth - mean_truth_);
+
+    PosePair pair;
+    pair.timestamp = timestamp;
+    pair.C_estimate = q.toRotationMatrix();
+    pair.r_estimate = r;
+    pair.C_truth = q_truth.toRotationMatrix();
+    pair.r_truth = r_truth;
+    window_.push_back(pair);
+
+    // compare with the latest pose at least one interval back
+    while(window_.size() > 2 && window_[1].timestamp <= timestamp - rpe_interval_)
+        window_.pop_front();
+    const PosePair& first = window_.front();
+    if(window_.size() > 1 && first.timestamp <= timestamp - rpe_interval_){
+        const Eigen::Matrix3d dC_estimate = first.C_estimate.transpose() * pair.C_estimate;
+        const Eigen::Vector3d dr_estimate = first.C_estimate.transpose() * (pair.r_estimate - first.r_estimate);
+        const Eigen::Matrix3d dC_truth = first.C_truth.transpose() * pair.C_truth;
+        const Eigen::Vector3d dr_truth = first.C_truth.transpose() * (pair.r_truth - first.r_truth);
+        const Eigen::Matrix3d C_error = dC_truth.transpose() * dC_estimate;
+        const double translation = (dC_truth.transpose() * (dr_estimate - dr_truth)).norm();
+        const double rotation = std::acos(std::max(-1.0, std::min(1.0, (C_error.trace() - 1.0) * 0.5)));
+        rpe_count_++;
+        rpe_translation_sum_ += translation * translation;
+        rpe_rotation_sum_ += rotation * rotation;
+    }
+    return true;
+}
+
+TrajectoryEvaluator::Result TrajectoryEvaluator::result() const{
+    Result result;
+    Eigen::Matrix3d cross;
+    double spread;
+    Eigen::Vector3d mean_estimate, mean_truth;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        result.count = count_;
+        result.missing = missing_;
+        result.rpe_count = rpe_count_;
+        result.rpe_translation = rpe_count_ ? std::sqrt(rpe_translation_sum_ / rpe_count_) : 0.0;
+        result.rpe_rotation = rpe_count_ ? std::sqrt(rpe_rotation_sum_ / rpe_count_) * 180.0 / M_PI : 0.0;
+        cross = cross_;
+        spread = spread_estimate_ + spread_truth_;
+        mean_estimate = mean_estimate_;
+        mean_truth = mean_truth_;
+    }
+
+    // R = argmax trace(R * cross) = V * D * U^T
+    Eigen::JacobiSVD<Eigen::Matrix3d> svd(cross, Eigen::ComputeFullU | Eigen::ComputeFullV);
+    Eigen::Vector3d d(1.0, 1.0, 1.0);
+    if((svd.matrixV() * svd.matrixU().transpose()).determinant() < 0.0)
+        d[2] = -1.0;
+    result.R = svd.matrixV() * d.asDiagonal() * svd.matrixU().transpose();
+    result.t = mean_truth - result.R * mean_estimate;
+    // the residual of the aligned positions follows from the moments alone
+    const double residual = spread - 2.0 * d.dot(svd.singularValues());
+    result.ate = result.count ? std::sqrt(std::max(0.0, residual) / result.count) : 0.0;
+    return result;
+}
+
+void TrajectoryEvaluator::print_results() const{
+    const Result r = result();
+    printf("\n--------------------------------------------------------------------\n");
+    printf("Evaluated states:  %14zu\n", r.count);
+    printf("No ground truth:   %14zu\n", r.missing);
+    printf("ATE [m]:           %14.4f\n", r.ate);
+    printf("RPE [m]:           %14.4f\n", r.rpe_translation);
+    printf("RPE [deg]:         %14.4f\n", r.rpe_rotation);
+    printf("--------------------------------------------------------------------\n");
+}
@@ -0,0 +1,112 @@
+#ifndef _TRAJECTORY_EVALUATOR_HPP_
+#define _TRAJECTORY_EVALUATOR_HPP_
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <cstdint>
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+///
+/// One pose of an ASL/EuRoC state_groundtruth_estimate0/data.csv file
+///
+struct GroundTruthSample{
+    int64_t timestamp;  ///< [ns]
+    double r[3];        ///< [m]
+    double q[4];        ///< w, x, y, z
+};
+
+///
+/// Time indexed ground truth trajectory
+///
+class GroundTruth
+{
+public:
+    /// Gaps in the ground truth longer than this are not interpolated over [ns]
+    static const int64_t kMaxGap = 100000000;
+
+    ///
+    /// Reads timestamp, position and orientation (w, x, y, z) from each line,
+    /// further columns are ignored. Throws std::runtime_error if the file cannot
+    /// be read or holds no poses.
+    ///
+    explicit GroundTruth(const std::string& filename);
+
+    ///
+    /// Pose at the given time [ns], interpolated linearly and by slerp.
+    /// Returns false outside of the recorded time or within gaps.
+    ///
+    bool interpolate(int64_t timestamp, Eigen::Vector3d& r, Eigen::Quaterniond& q) const;
+
+    size_t size() const { return samples_.size(); }
+
+private:
+    std::vector<GroundTruthSample> samples_;
+};
+
+///
+/// Streaming absolute trajectory error (ATE) and relative pose error (RPE)
+/// of estimates against a ground truth. The rigid alignment of the estimates
+/// to the ground truth (Umeyama, without scale) only needs the means and the
+/// cross covariance of the positions, which are updated with every estimate,
+/// so the ATE of the best alignment is available at any time without keeping
+/// the trajectory. The RPE compares the motion over a fixed time interval and
+/// only keeps the estimates within that interval.
+/// add() and result() may be called from different threads.
+///
+class TrajectoryEvaluator
+{
+public:
+    struct Result{
+        size_t count;            ///< estimates with ground truth
+        size_t missing;          ///< estimates without ground truth
+        double ate;              ///< RMSE of the aligned positions [m]
+        size_t rpe_count;
+        double rpe_translation;  ///< RMSE of the relative translation [m]
+        double rpe_rotation;     ///< RMSE of the relative rotation [deg]
+        Eigen::Matrix3d R;       ///< alignment, ground truth position = R * estimate + t
+        Eigen::Vector3d t;
+    };
+
+    /// rpe_interval is the time between the compared poses [ns]
+    TrajectoryEvaluator(const GroundTruth& ground_truth, int64_t rpe_interval = 1000000000);
+
+    /// Returns false if there is no ground truth at the time of the estimate
+    bool add(int64_t timestamp, const Eigen::Vector3d& r, const Eigen::Quaterniond& q);
+
+    Result result() const;
+
+    void print_results() const;
+
+private:
+    struct PosePair{
+        int64_t timestamp;
+        Eigen::Matrix3d C_estimate;
+        Eigen::Vector3d r_estimate;
+        Eigen::Matrix3d C_truth;
+        Eigen::Vector3d r_truth;
+    };
+
+    const GroundTruth& ground_truth_;
+    const int64_t rpe_interval_;
+
+    mutable std::mutex mutex_;
+    // running means and centered second moments of the positions
+    size_t count_;
+    size_t missing_;
+    Eigen::Vector3d mean_estimate_;
+    Eigen::Vector3d mean_truth_;
+    Eigen::Matrix3d cross_;        ///< sum of (estimate - mean) (truth - mean)^T
+    double spread_estimate_;       ///< sum of |estimate - mean|^2
+    double spread_truth_;
+    // relative pose errors
+    std::deque<PosePair> window_;
+    size_t rpe_count_;
+    double rpe_translation_sum_;   ///< of squares
+    double rpe_rotation_sum_;
+};
+
+#endif
@@ -0,0 +1,143 @@
+#include "trajectory_writer.hpp"
+
+#include <stdexcept>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+
+namespace{
+
+    const size_t kBlockSize = 1 << 20;  ///< written once the buffer holds this much
+    const std::chrono::milliseconds kIdleInterval(10);
+    const std::chrono::seconds kFlushInterval(1);  ///< latest data reaches the file at least this often
+
+    bool ends_with(const std::string& s, const std::string& suffix){
+        return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+
+}
+
+TrajectoryWriter::Format TrajectoryWriter::format_for(const std::string& filename){
+    if(ends_with(filename, ".tum") || ends_with(filename, ".txt"))
+        return kTum;
+    if(ends_with(filename, ".bin"))
+        return kBinary;
+    return kEuroc;
+}
+
+TrajectoryWriter::TrajectoryWriter(const std::string& filename, Format format):
+filename_(filename),
+format_(format),
+file_(filename, std::ios::binary | std::ios::trunc),
+pushed_(0),
+stop_(false),
+closed_(false)
+{
+    if(!file_.good())
+        throw std::runtime_error("cannot create " + filename);
+    buffer_.reserve(kBlockSize + 4096);
+
+    if(format_ == kEuroc){
+        const char header[] = "#timestamp, p_RS_R_x [m], p_RS_R_y [m], p_RS_R_z [m], "
+            "q_RS_w [], q_RS_x [], q_RS_y [], q_RS_z [], "
+            "v_RS_R_x [m s^-1], v_RS_R_y [m s^-1], v_RS_R_z [m s^-1], "
+            "b_w_RS_S_x [rad s^-1], b_w_RS_S_y [rad s^-1], b_w_RS_S_z [rad s^-1], "
+            "b_a_RS_S_x [m s^-2], b_a_RS_S_y [m s^-2], b_a_RS_S_z [m s^-2], "
+            "w_RS_S_x [rad s^-1], w_RS_S_y [rad s^-1], w_RS_S_z [rad s^-1]\n";
+        buffer_.insert(buffer_.end(), header, header + sizeof(header) - 1);
+    } else if(format_ == kTum){
+        const char header[] = "# timestamp tx ty tz qx qy qz qw\n";
+        buffer_.insert(buffer_.end(), header, header + sizeof(header) - 1);
+    } else{
+        TrajectoryFile::Header header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, TrajectoryFile::kMagic, sizeof(header.magic));
+        header.version = TrajectoryFile::kVersion;
+        header.record_size = sizeof(StateRecord);
+        const char* bytes = reinterpret_cast<const char*>(&header);
+        buffer_.insert(buffer_.end(), bytes, bytes + sizeof(header));
+    }
+
+    worker_ = std::thread(&TrajectoryWriter::run, this);
+}
+
+TrajectoryWriter::~TrajectoryWriter(){
+    close();
+}
+
+void TrajectoryWriter::push(const StateRecord& state){
+    queue_.push(state);
+    pushed_.store(pushed_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+bool TrajectoryWriter::close(){
+    if(!closed_){
+        closed_ = true;
+        stop_ = true;
+        worker_.join();
+        file_.close();
+        if(file_.fail())
+            fprintf(stderr, "%s: writing failed\n", filename_.c_str());
+        if(queue_.dropped() > 0)
+            fprintf(stderr, "%s: %llu states dropped\n", filename_.c_str(),
+                    (unsigned long long)queue_.dropped());
+    }
+    return !file_.fail();
+}
+
+void TrajectoryWriter::run(){
+    StateRecord state;
+    auto last_write = std::chrono::steady_clock::now();
+    while(true){
+        // read stop before draining, so nothing pushed before close() is missed
+        const bool stop = stop_;
+        bool any = false;
+        while(buffer_.size() < kBlockSize && queue_.pop(state)){
+            format(state);
+            any = true;
+        }
+        const auto now = std::chrono::steady_clock::now();
+        if(buffer_.size() >= kBlockSize || (!buffer_.empty() && (stop || now - last_write >= kFlushInterval))){
+            write();
+            last_write = now;
+        }
+        if(!any){
+            if(stop)
+                break;
+            std::this_thread::sleep_for(kIdleInterval);
+        }
+    }
+    file_.flush();
+}
+
+void TrajectoryWriter::format(const StateRecord& s){
+    if(format_ == kBinary){
+        const char* bytes = reinterpret_cast<const char*>(&s);
+        buffer_.insert(buffer_.end(), bytes, bytes + sizeof(s));
+        return;
+    }
+    char line[512];
+    int n;
+    if(format_ == kTum){
+        n = snprintf(line, sizeof(line), "%lld.%09lld %.9g %.9g %.9g %.9g %.9g %.9g %.9g\n",
+                     (long long)(s.timestamp / 1000000000), (long long)(s.timestamp % 1000000000),
+                     s.r[0], s.r[1], s.r[2], s.q[1], s.q[2], s.q[3], s.q[0]);
+    } else{
+        const double* v = s.speed_and_biases;
+        n = snprintf(line, sizeof(line),
+                     "%lld,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,"
+                     "%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g\n",
+                     (long long)s.timestamp, s.r[0], s.r[1], s.r[2], s.q[0], s.q[1], s.q[2], s.q[3],
+                     v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7], v[8],
+                     s.omega[0], s.omega[1], s.omega[2]);
+    }
+    if(n > 0)
+        buffer_.insert(buffer_.end(), line, line + std::min(n, int(sizeof(line)) - 1));
+}
+
+void TrajectoryWriter::write(){
+    file_.write(buffer_.data(), buffer_.size());
+    file_.flush();
+    buffer_.clear();
+}
@@ -0,0 +1,104 @@
+#ifndef _TRAJECTORY_WRITER_HPP_
+#define _TRAJECTORY_WRITER_HPP_
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+
+#include "snapshot_queue.hpp"
+
+///
+/// Full state of the estimator at one point in time, also the record of
+/// binary trajectory files
+///
+struct StateRecord{
+    int64_t timestamp;           ///< [ns]
+    double r[3];                 ///< position of the sensor in the world frame [m]
+    double q[4];                 ///< orientation, w, x, y, z
+    double speed_and_biases[9];  ///< velocity [m/s], gyro bias [rad/s], accelerometer bias [m/s^2]
+    double omega[3];             ///< rotation rate in the sensor frame [rad/s]
+};
+
+///
+/// Binary trajectory file: a header followed by StateRecords back to back,
+/// so the file can be memory mapped and used as an array. A trailing partial
+/// record (interrupted run) is to be ignored.
+///
+namespace TrajectoryFile{
+
+    const char kMagic[8] = {'O','K','V','I','S','T','R','J'};
+    const uint32_t kVersion = 1;
+
+    struct Header{
+        char magic[8];
+        uint32_t version;
+        uint32_t record_size;  ///< sizeof(StateRecord)
+        uint64_t reserved[6];
+    };
+
+    static_assert(sizeof(Header) == 64, "header keeps the records 64 byte aligned");
+    static_assert(sizeof(StateRecord) == 160, "records are stored as they are in memory");
+
+}
+
+///
+/// Records estimator states to a file on a background thread.
+/// push() only copies the state into a lock-free ring, so the estimator's
+/// thread never waits for the disk. The worker formats the records into a
+/// large buffer which is written in big blocks. close() (or the destructor)
+/// writes everything pushed before it.
+///
+class TrajectoryWriter
+{
+public:
+    enum Format{
+        kEuroc,   ///< csv with the columns of the EuRoC state ground truth, then omega
+        kTum,     ///< "timestamp[s] tx ty tz qx qy qz qw", the pose only
+        kBinary   ///< see TrajectoryFile
+    };
+
+    /// Format from the file extension: .tum or .txt is TUM, .bin binary, anything else EuRoC
+    static Format format_for(const std::string& filename);
+
+    /// Throws std::runtime_error if the file cannot be created
+    TrajectoryWriter(const std::string& filename, Format format);
+
+    ~TrajectoryWriter();
+
+    /// Called from a single producer thread, never blocks
+    void push(const StateRecord& state);
+
+    ///
+    /// Writes all pushed states and closes the file, returns false on errors.
+    /// Write errors and dropped states are reported on stderr.
+    ///
+    bool close();
+
+    /// Number of states pushed
+    uint64_t size() const { return pushed_; }
+
+    /// States dropped because the writer could not keep up
+    uint64_t dropped() const { return queue_.dropped(); }
+
+private:
+    void run();
+
+    void format(const StateRecord& state);
+
+    void write();
+
+    std::string filename_;
+    Format format_;
+    std::ofstream file_;
+    std::vector<char> buffer_;
+    SnapshotQueue<StateRecord, 16384> queue_;
+    std::atomic<uint64_t> pushed_;
+    std::atomic<bool> stop_;
+    std::thread worker_;
+    bool closed_;
+};
+
+#endif